@@ -0,0 +1,227 @@
+// Benchmarks for the physics, integration and search code. Everything uses
+// fixed seeds, so runs are comparable across builds. Run with
+//
+//   ./gliders_bench --benchmark_format=json
+//
+// or --benchmark_out=results.json for machine readable results.
+
+#include <array>
+#include <random>
+#include <vector>
+#include <benchmark/benchmark.h>
+
+#include "exact_field.hpp"
+#include "gliders_core.hpp"
+#include "integrator.hpp"
+
+namespace {
+
+const std::array<point, 2> bounds {point(0.f, 0.f), point(1800.f, 1000.f)};
+const float spiral_factor = 4.f;
+const std::size_t max_steps = 200;
+
+// Planets of the same seed for every benchmark
+std::mt19937 planetRng() {
+    return std::mt19937(3);
+}
+
+std::vector<point> probePoints(const std::size_t n) {
+    std::mt19937 rng(1);
+    std::vector<point> points(n);
+    for (auto& p : points) p = point::randomPoint(bounds, rng);
+    return points;
+}
+
+template <typename Probe>
+void runProbe(benchmark::State& state, Probe&& probe) {
+    auto rng = planetRng();
+    const System system (state.range(0), bounds, rng);
+    const auto points = probePoints(1024);
+
+    std::size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(probe(system, points[i++ & 1023]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_ProbeGravity(benchmark::State& state) {
+    runProbe(state, [](System const& s, point const& p) { return s.probeGravity(p); });
+}
+BENCHMARK(BM_ProbeGravity)->RangeMultiplier(10)->Range(10, 10000);
+
+void BM_ProbePotential(benchmark::State& state) {
+    runProbe(state, [](System const& s, point const& p) { return s.probePotential(p); });
+}
+BENCHMARK(BM_ProbePotential)->RangeMultiplier(10)->Range(10, 10000);
+
+void BM_ProbeAngularPotentialGradient(benchmark::State& state) {
+    runProbe(state, [](System const& s, point const& p) {
+        return s.probeAngularPotentialGradient(p);
+    });
+}
+BENCHMARK(BM_ProbeAngularPotentialGradient)->RangeMultiplier(10)->Range(10, 10000);
+
+void BM_ProbeTotalGradient(benchmark::State& state) {
+    runProbe(state, [](System const& s, point const& p) {
+        return s.probeTotalGradient(p, spiral_factor);
+    });
+}
+BENCHMARK(BM_ProbeTotalGradient)->RangeMultiplier(10)->Range(10, 10000);
+
+// One probe of a whole lane batch, items are single probes
+void BM_ProbeTotalGradientBatch(benchmark::State& state) {
+    auto rng = planetRng();
+    const System system (state.range(0), bounds, rng);
+    const auto points = probePoints(1024);
+
+    std::size_t i = 0;
+    for (auto _ : state) {
+        PointBatch batch;
+        for (std::size_t l = 0; l < PointBatch::lanes; ++l) {
+            batch.set(l, points[(i + l) & 1023]);
+        }
+        i += PointBatch::lanes;
+        benchmark::DoNotOptimize(system.probeTotalGradient(batch, spiral_factor));
+    }
+    state.SetItemsProcessed(state.iterations() * PointBatch::lanes);
+}
+BENCHMARK(BM_ProbeTotalGradientBatch)->RangeMultiplier(10)->Range(10, 10000);
+
+// A single glider step with each of the integrators
+enum class Integrator { euler, midpoint, rk4, dormand_prince };
+
+void BM_GliderStep(benchmark::State& state) {
+    auto rng = planetRng();
+    const System system (10, bounds, rng);
+    const auto integrator = static_cast<Integrator>(state.range(0));
+    auto motion = [&](point const& p) {
+        return equipotentialMotion(p, spiral_factor, system, true);
+    };
+
+    point pos = point(900.f, 500.f);
+    for (auto _ : state) {
+        point next;
+        switch (integrator) {
+        case Integrator::euler:
+            next = integrator::explicitEuler(pos, motion, glider_stepsize);
+            break;
+        case Integrator::midpoint:
+            next = integrator::midpoint(pos, motion, glider_stepsize);
+            break;
+        case Integrator::rk4:
+            next = integrator::rungeKutta4(pos, motion, glider_stepsize);
+            break;
+        case Integrator::dormand_prince:
+            {
+                point error;
+                next = integrator::dormandPrince(pos, motion, glider_stepsize, error);
+            }
+            break;
+        }
+        benchmark::DoNotOptimize(next);
+        // Keep the glider inside the bounds, so every step costs the same
+        pos = next.x > bounds[0].x && next.x < bounds[1].x &&
+              next.y > bounds[0].y && next.y < bounds[1].y ? next : point(900.f, 500.f);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GliderStep)->DenseRange(0, 3)->ArgName("integrator");
+
+void BM_GenerateGliderTrajectory(benchmark::State& state) {
+    auto rng = planetRng();
+    const System system (state.range(0), bounds, rng);
+    const auto starts = randomGliderStarts(64, 1, bounds);
+
+    std::vector<point> points;
+    std::size_t i = 0;
+    for (auto _ : state) {
+        GliderStart const& start = starts[i++ & 63];
+        generateGliderTrajectory(start.pos, system, spiral_factor, max_steps, start.ccw, points);
+        benchmark::DoNotOptimize(points.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GenerateGliderTrajectory)->Arg(10)->Arg(100)->Arg(1000);
+
+void BM_GenerateAdaptiveGliderTrajectory(benchmark::State& state) {
+    auto rng = planetRng();
+    const System system (10, bounds, rng);
+    const auto starts = randomGliderStarts(64, 1, bounds);
+
+    std::size_t i = 0;
+    for (auto _ : state) {
+        GliderStart const& start = starts[i++ & 63];
+        benchmark::DoNotOptimize(generateAdaptiveGliderTrajectory(
+            start.pos, system, spiral_factor, max_steps * glider_stepsize, 0.01f, start.ccw));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GenerateAdaptiveGliderTrajectory);
+
+// All gliders of a picture on one thread, through each of the backends
+enum class Backend { exact, field_grid, barnes_hut, specialized };
+
+void BM_GenerateGliderTrajectories(benchmark::State& state) {
+    auto rng = planetRng();
+    const System system (state.range(1), bounds, rng);
+    const auto starts = randomGliderStarts(1000, 1, bounds);
+    TrajectoryPool pool;
+
+    auto run = [&](auto const& field) {
+        for (auto _ : state) {
+            generateGliderTrajectories(starts, field, spiral_factor, max_steps, pool, 1);
+            benchmark::DoNotOptimize(pool[0].data());
+        }
+    };
+
+    switch (static_cast<Backend>(state.range(0))) {
+    case Backend::exact:
+        run(system);
+        break;
+    case Backend::field_grid:
+        run(FieldGrid(system, bounds, 4.f, 16.f, 1));
+        break;
+    case Backend::barnes_hut:
+        run(BarnesHut(system, 0.5f));
+        break;
+    case Backend::specialized:
+        withExactField(system, spiral_factor, run);
+        break;
+    }
+    state.SetItemsProcessed(state.iterations() * starts.size());
+}
+BENCHMARK(BM_GenerateGliderTrajectories)
+    ->ArgsProduct({{0, 1, 2, 3}, {10, 1000}})->ArgNames({"backend", "planets"})
+    ->Unit(benchmark::kMillisecond);
+
+void BM_ScorePath(benchmark::State& state) {
+    auto rng = planetRng();
+    const System system (state.range(0), bounds, rng);
+    const NearestPlanetIndex planets(system, bounds);
+    const auto path = generateGliderTrajectory(point(900.f, 500.f), system, spiral_factor,
+                                               max_steps, true);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(scorePath(planets, bounds, path));
+    }
+    state.SetItemsProcessed(state.iterations() * path.size());
+}
+BENCHMARK(BM_ScorePath)->RangeMultiplier(10)->Range(10, 10000);
+
+void BM_FindNicePath(benchmark::State& state) {
+    auto rng = planetRng();
+    const System system (10, bounds, rng);
+    const auto strategy = static_cast<SearchStrategy>(state.range(0));
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(findNicePath(system, system, spiral_factor, max_steps,
+                                              bounds, 1, strategy, 1));
+    }
+}
+BENCHMARK(BM_FindNicePath)->DenseRange(0, 3)->ArgName("strategy")
+    ->Unit(benchmark::kMillisecond);
+
+} // namespace
+
+BENCHMARK_MAIN();
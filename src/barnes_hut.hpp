@@ -0,0 +1,274 @@
+#ifndef BARNES_HUT_HPP
+#define BARNES_HUT_HPP
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "fast_math.hpp"
+#include "point.hpp"
+#include "point_batch.hpp"
+#include "profile.hpp"
+#include "system.hpp"
+
+// Barnes-Hut approximation of the System fields for large planet counts.
+// The planets are sorted into a quadtree, and every tree node that is far
+// enough away from the probe, meaning its size over its distance is below
+// the opening angle theta, is replaced by a single body at its centre of
+// mass. For the angular potential, where the planets' signed masses (mass
+// * spin) can cancel out, the ccw and the cw planets of a node are
+// replaced by one body each, at their own centres of mass.
+//
+// A probe costs O(log n) instead of O(n), and theta = 0 gives back the
+// exact sums.
+
+class BarnesHut {
+    struct Node {
+        point centre; // centre of mass
+        float mass;
+        point ccw_centre, cw_centre;
+        float ccw_mass, cw_mass;
+        float size;   // side length of the node's square
+        std::uint32_t begin, end; // range in the sorted planet arrays
+        std::int32_t children[4]; // -1 where empty, all -1 for leaves
+    };
+
+    float gravitational_constant;
+    float sq_theta;
+    std::vector<Node> nodes;
+
+    // Planets in tree order
+    std::vector<point> positions;
+    std::vector<float> masses;
+    std::vector<float> spin_masses;
+
+    static const std::size_t leaf_size = 8;
+    static const int max_depth = 24;
+
+    // Planet indices in tree order, and where the planets were when the
+    // tree was built
+    std::vector<std::uint32_t> order;
+    std::vector<point> built_positions;
+
+    // Masses and centres of mass of the planets [n.begin, n.end)
+    static void summarize(Node& n, std::vector<std::uint32_t> const& order,
+                          std::vector<Planet> const& planets) {
+        n.mass = n.ccw_mass = n.cw_mass = 0;
+        point ccw_weighted, cw_weighted;
+        for (std::size_t i = n.begin; i < n.end; ++i) {
+            Planet const& p = planets[order[i]];
+            if (p.ccw) {
+                n.ccw_mass += p.mass;
+                ccw_weighted += p.pos * p.mass;
+            } else {
+                n.cw_mass += p.mass;
+                cw_weighted += p.pos * p.mass;
+            }
+        }
+        n.mass = n.ccw_mass + n.cw_mass;
+        const point fallback = planets[order[n.begin]].pos;
+        n.centre = n.mass > 0 ? (ccw_weighted + cw_weighted) / n.mass : fallback;
+        n.ccw_centre = n.ccw_mass > 0 ? ccw_weighted / n.ccw_mass : fallback;
+        n.cw_centre = n.cw_mass > 0 ? cw_weighted / n.cw_mass : fallback;
+    }
+
+    void copyPlanets(std::vector<Planet> const& planets) {
+        positions.clear();
+        masses.clear();
+        spin_masses.clear();
+        for (const std::uint32_t i : order) {
+            positions.push_back(planets[i].pos);
+            masses.push_back(planets[i].mass);
+            spin_masses.push_back(planets[i].ccw ? planets[i].mass : -planets[i].mass);
+        }
+    }
+
+    std::int32_t build(std::vector<std::uint32_t>& order, const std::size_t begin,
+                       const std::size_t end, point const& corner, const float size,
+                       const int depth, std::vector<Planet> const& planets) {
+        if (begin == end) return -1;
+
+        const std::int32_t id = nodes.size();
+        nodes.push_back({});
+        {
+            Node& n = nodes.back();
+            n.begin = begin;
+            n.end = end;
+            n.size = size;
+            summarize(n, order, planets);
+            std::fill(std::begin(n.children), std::end(n.children), -1);
+        }
+
+        if (end - begin <= leaf_size || depth >= max_depth) return id;
+
+        // Partition into the quadrants around the midpoint
+        const float half = size / 2;
+        const point mid = corner + point(half, half);
+        auto quadrant = [&](const std::uint32_t i) {
+            point const& p = planets[i].pos;
+            return (p.x >= mid.x ? 1 : 0) + (p.y >= mid.y ? 2 : 0);
+        };
+
+        std::array<std::size_t, 5> split;
+        split[0] = begin;
+        for (int q = 0; q < 4; ++q) {
+            split[q + 1] = std::partition(order.begin() + split[q], order.begin() + end,
+                                          [&](const std::uint32_t i) { return quadrant(i) == q; })
+                - order.begin();
+        }
+
+        for (int q = 0; q < 4; ++q) {
+            const point child_corner = corner + point(q & 1 ? half : 0, q & 2 ? half : 0);
+            const std::int32_t child = build(order, split[q], split[q + 1], child_corner,
+                                             half, depth + 1, planets);
+            nodes[id].children[q] = child;
+        }
+
+        return id;
+    }
+
+    // Calls body(centre, mass, spin_mass) for every planet or far node that
+    // makes up the field at pos.
+    template <typename Body>
+    void traverse(point const& pos, Body&& body) const {
+        if (nodes.empty()) return;
+
+        std::int32_t stack[4 * max_depth + 4];
+        int top = 0;
+        stack[top++] = 0;
+
+        while (top > 0) {
+            Node const& n = nodes[stack[--top]];
+            const float sq_dist = (pos - n.centre).sqmag();
+
+            if (n.size * n.size < sq_theta * sq_dist) {
+                body(n.centre, n.mass, 0.f);
+                if (n.ccw_mass > 0) body(n.ccw_centre, 0.f, n.ccw_mass);
+                if (n.cw_mass > 0) body(n.cw_centre, 0.f, -n.cw_mass);
+                continue;
+            }
+
+            if (n.children[0] < 0 && n.children[1] < 0 &&
+                n.children[2] < 0 && n.children[3] < 0) {
+                for (std::size_t i = n.begin; i < n.end; ++i) {
+                    body(positions[i], masses[i], spin_masses[i]);
+                }
+                continue;
+            }
+
+            for (const std::int32_t c : n.children) {
+                if (c >= 0) stack[top++] = c;
+            }
+        }
+    }
+
+public:
+    BarnesHut(System const& system, const float theta = 0.5f)
+        : gravitational_constant(system.gravitationalConstant()), sq_theta(theta * theta) {
+        profile::ScopedTimer timer ("build barnes-hut");
+        auto const& planets = system.planets();
+        if (planets.empty()) return;
+
+        point lo = planets[0].pos, hi = planets[0].pos;
+        for (auto const& p : planets) {
+            lo = point(std::min(lo.x, p.pos.x), std::min(lo.y, p.pos.y));
+            hi = point(std::max(hi.x, p.pos.x), std::max(hi.y, p.pos.y));
+        }
+        // Slightly larger, so the planets on the upper edge are inside
+        const float size = std::max(hi.x - lo.x, hi.y - lo.y) * 1.0001f + 1e-3f;
+
+        order.resize(planets.size());
+        for (std::size_t i = 0; i < order.size(); ++i) order[i] = i;
+
+        build(order, 0, order.size(), lo, size, 0, planets);
+        copyPlanets(planets);
+        built_positions = positions;
+    }
+
+    // Updates the tree for planets that have moved or changed their mass,
+    // keeping its structure: the nodes keep their squares and planets, and
+    // only their masses and centres of mass are computed again, which takes
+    // a fraction of a rebuild. The sums are the same up to rounding, as
+    // they are added up in another order. The planets moving
+    // out of their squares makes the opening criterion less accurate
+    // though, so this refuses and returns false if system does not have the
+    // same number of planets, or if any planet moved further than max_drift
+    // from where it was when the tree was built. Rebuild it then.
+    bool refit(System const& system, const float max_drift) {
+        profile::ScopedTimer timer ("refit barnes-hut");
+        auto const& planets = system.planets();
+        if (planets.size() != order.size() || planets.empty()) return false;
+
+        const float sq_max_drift = max_drift * max_drift;
+        for (std::size_t i = 0; i < order.size(); ++i) {
+            if ((planets[order[i]].pos - built_positions[i]).sqmag() > sq_max_drift) {
+                return false;
+            }
+        }
+
+        for (Node& n : nodes) summarize(n, order, planets);
+        copyPlanets(planets);
+        return true;
+    }
+
+    point probeGravity(point const& pos) const {
+        point out {0.f, 0.f};
+        traverse(pos, [&](point const& centre, const float mass, float) {
+            const point r = pos - centre;
+            const float sq = r.sqmag();
+            out -= r * fastmath::overDistanceCubed(mass, sq);
+        });
+
+        return out * gravitational_constant;
+    }
+
+    float probePotential(point const& pos) const {
+        float out = 0.f;
+        traverse(pos, [&](point const& centre, const float mass, float) {
+            out -= fastmath::overDistance(mass, (pos - centre).sqmag());
+        });
+
+        return out * gravitational_constant;
+    }
+
+    point probeAngularPotentialGradient(point const& pos) const {
+        point out {0.f, 0.f};
+        traverse(pos, [&](point const& centre, float, const float spin_mass) {
+            const point r = pos - centre;
+            out += point(r.y, -r.x) * fastmath::overDistanceSquared(spin_mass, r.sqmag());
+        });
+
+        return out;
+    }
+
+    // Same as System::probeTotalGradient
+    point probeTotalGradient(point const& pos, const float angular_factor) const {
+        point out {0.f, 0.f};
+        traverse(pos, [&](point const& centre, const float mass, const float spin_mass) {
+            const point r = pos - centre;
+            float inv_sq, inv_dist;
+            fastmath::inverseSquare(r.sqmag(), inv_sq, inv_dist);
+            const float grav = gravitational_constant * mass * inv_sq * inv_dist;
+            const float ang = angular_factor * spin_mass * inv_sq;
+            out += point(r.x * grav - r.y * ang, r.y * grav + r.x * ang);
+        });
+
+        return out;
+    }
+
+    PointBatch probeTotalGradient(PointBatch const& pos, const float angular_factor) const {
+        PointBatch out;
+        for (std::size_t l = 0; l < PointBatch::lanes; ++l) {
+            out.set(l, probeTotalGradient(pos[l], angular_factor));
+        }
+        return out;
+    }
+
+    // The batch probe is the single one for every lane
+    point probeLaneTotalGradient(point const& pos, const float angular_factor) const {
+        return probeTotalGradient(pos, angular_factor);
+    }
+};
+
+#endif // BARNES_HUT_HPP
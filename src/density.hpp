@@ -0,0 +1,149 @@
+#ifndef DENSITY_HPP
+#define DENSITY_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "parallel.hpp"
+#include "point.hpp"
+#include "raster.hpp"
+#include "trajectory_pool.hpp"
+
+// Pictures by counting instead of blending: every trajectory adds its
+// antialiased coverage to a float per pixel, and the counts become colours
+// only at the end, through a tone map. Unlike blending many faint lines
+// into 8 bit colours this does not band or saturate, and the memory only
+// depends on the resolution, not on how many gliders are drawn.
+
+class DensityBuffer {
+    unsigned width_, height_;
+    std::vector<float> hits;
+
+public:
+    DensityBuffer(const unsigned width, const unsigned height)
+        : width_(width), height_(height), hits(static_cast<std::size_t>(width) * height) {}
+
+    unsigned width() const { return width_; }
+    unsigned height() const { return height_; }
+
+    void clear() { std::fill(hits.begin(), hits.end(), 0.f); }
+
+    float at(const unsigned x, const unsigned y) const {
+        return hits[static_cast<std::size_t>(y) * width_ + x];
+    }
+
+    float max() const {
+        return hits.empty() ? 0.f : *std::max_element(hits.begin(), hits.end());
+    }
+
+    // The count that fraction of the pixels with any hits stay below
+    float percentile(const float fraction) const {
+        std::vector<float> nonzero;
+        for (const float h : hits) {
+            if (h > 0) nonzero.push_back(h);
+        }
+        if (nonzero.empty()) return 0.f;
+        const std::size_t i = std::min(nonzero.size() - 1,
+                                       static_cast<std::size_t>(fraction * nonzero.size()));
+        std::nth_element(nonzero.begin(), nonzero.begin() + i, nonzero.end());
+        return nonzero[i];
+    }
+
+    void addLine(point const& a, point const& b, const float weight = 1.f) {
+        rasterizeLine(a, b, width_, height_, [&](const int x, const int y, const float coverage) {
+            if (x < 0 || y < 0 || x >= static_cast<int>(width_) || y >= static_cast<int>(height_)) {
+                return;
+            }
+            hits[static_cast<std::size_t>(y) * width_ + x] += coverage * weight;
+        });
+    }
+
+    void addPolyline(PointSpan points, const float weight = 1.f) {
+        for (std::size_t i = 1; i < points.size(); ++i) {
+            addLine(points[i - 1], points[i], weight);
+        }
+    }
+
+    // Adds the counts of other, which has to be of the same size, like the
+    // buffer of another thread
+    DensityBuffer& operator+=(DensityBuffer const& other) {
+        for (std::size_t i = 0; i < hits.size(); ++i) {
+            hits[i] += other.hits[i];
+        }
+        return *this;
+    }
+};
+
+// Adds every trajectory but skip, anything with size() and operator[] like
+// a TrajectoryPool, with its points mapped by transform, to one of the
+// buffers on each of their threads. Reduce them with += afterwards.
+template <typename Trajectories, typename Transform>
+void accumulateDensity(Trajectories const& trajectories, Transform const& transform,
+                       std::vector<DensityBuffer>& buffers, const std::size_t skip = -1) {
+    parallel::forEach(trajectories.size(), [&](const unsigned thread, const std::size_t i) {
+        if (i == skip) return;
+        auto const& points = trajectories[i];
+        if (points.size() < 2) return;
+        point last = transform(points[0]);
+        for (std::size_t j = 1; j < points.size(); ++j) {
+            const point p = transform(points[j]);
+            buffers[thread].addLine(last, p);
+            last = p;
+        }
+    }, buffers.size(), 64);
+}
+
+enum class ToneMap {
+    // log(1 + exposure * hits), scaled so that all but the densest 0.5% of
+    // the pixels stay below white. The few pixels around the planets that
+    // the gliders circle thousands of times would otherwise leave
+    // everything else dark.
+    log,
+    // The ACES fit of Krzysztof Narkowicz on exposure * hits, which keeps
+    // the contrast of the sparse parts and rolls off smoothly into white
+    filmic
+};
+
+inline std::istream& operator>>(std::istream& in, ToneMap& tone_map) {
+    std::string name;
+    in >> name;
+    if (name == "log") tone_map = ToneMap::log;
+    else if (name == "filmic") tone_map = ToneMap::filmic;
+    else in.setstate(std::ios::failbit);
+    return in;
+}
+
+inline std::ostream& operator<<(std::ostream& out, const ToneMap tone_map) {
+    return out << (tone_map == ToneMap::log ? "log" : "filmic");
+}
+
+// The counts as a picture, from background for no hits to colour for the
+// brightest. colour's alpha is not used.
+inline Canvas toneMap(DensityBuffer const& density, const ToneMap tone_map, const float exposure,
+                      Rgba const& background, Rgba const& colour) {
+    Canvas canvas(density.width(), density.height(), background);
+    Rgba opaque = colour;
+    opaque.a = 1.f;
+
+    const float white = tone_map == ToneMap::log ? density.percentile(0.995f) : 0.f;
+    const float log_scale = 1.f / std::log1p(exposure * std::max(white, 1e-6f));
+    auto curve = [&](const float hits) {
+        if (tone_map == ToneMap::log) {
+            return std::min(1.f, std::log1p(exposure * hits) * log_scale);
+        }
+        const float x = exposure * hits;
+        return std::min(1.f, x * (2.51f * x + 0.03f) / (x * (2.43f * x + 0.59f) + 0.14f));
+    };
+
+    for (unsigned y = 0; y < density.height(); ++y) {
+        for (unsigned x = 0; x < density.width(); ++x) {
+            const float hits = density.at(x, y);
+            if (hits > 0) canvas.blend(x, y, opaque, curve(hits));
+        }
+    }
+    return canvas;
+}
+
+#endif // DENSITY_HPP
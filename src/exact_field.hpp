@@ -0,0 +1,151 @@
+#ifndef EXACT_FIELD_HPP
+#define EXACT_FIELD_HPP
+
+#include <array>
+#include <cstddef>
+#include "fast_math.hpp"
+#include "planet_arrays.hpp"
+#include "point.hpp"
+#include "point_batch.hpp"
+#include "simd.hpp"
+#include "system.hpp"
+
+// The exact field of a System, with more of it fixed at compile time than
+// System itself does: whether the angular term is there at all, and for
+// the usual small systems the number of planets, so the planet loop of the
+// batch kernel has a constant trip count and is unrolled completely.
+//
+// withExactField picks the instantiation for a system once, and the
+// result can be used wherever a Field is taken. The batch probes do the
+// same operations in the same order as System's, so with the
+// -ffp-contract=off that gliders_core builds with the trajectories are the
+// same.
+//
+// Every instantiation multiplies the code of whatever is run with the
+// field, so only the planet counts of the usual presets get their own.
+
+// The planets of a system without the padding, in arrays of a fixed size
+template <std::size_t N>
+struct FixedPlanets {
+    std::array<float, N> x, y, g_mass, spin_mass;
+
+    explicit FixedPlanets(PlanetArrays const& planets) {
+        for (std::size_t i = 0; i < N; ++i) {
+            x[i] = planets.x[i];
+            y[i] = planets.y[i];
+            g_mass[i] = planets.g_mass[i];
+            spin_mass[i] = planets.spin_mass[i];
+        }
+    }
+
+    static constexpr std::size_t size() { return N; }
+};
+
+namespace kernels {
+    // kernels::totalGradient for a batch, for FixedPlanets or PlanetArrays,
+    // and without the angular term unless Angular.
+    template <bool Angular, typename Planets>
+    PointBatch totalGradient(Planets const& planets, PointBatch const& pos,
+                             const float angular_factor) {
+        using simd::vfloat;
+        static_assert(PointBatch::lanes % vfloat::width == 0,
+                      "PointBatch lanes have to fill whole vectors");
+
+        PointBatch out;
+        for (std::size_t l = 0; l < PointBatch::lanes; l += vfloat::width) {
+            const vfloat px = vfloat::load(&pos.x[l]);
+            const vfloat py = vfloat::load(&pos.y[l]);
+            const vfloat af(angular_factor);
+            vfloat out_x(0.f), out_y(0.f);
+
+            for (std::size_t i = 0; i < planets.size(); ++i) {
+                const vfloat rx = px - vfloat(planets.x[i]);
+                const vfloat ry = py - vfloat(planets.y[i]);
+                vfloat inv_sq, inv_dist;
+                fastmath::inverseSquare(rx * rx + ry * ry, inv_sq, inv_dist);
+                const vfloat grav = vfloat(planets.g_mass[i]) * inv_sq * inv_dist;
+                if (Angular) {
+                    const vfloat ang = af * vfloat(planets.spin_mass[i]) * inv_sq;
+                    out_x += rx * grav - ry * ang;
+                    out_y += ry * grav + rx * ang;
+                } else {
+                    out_x += rx * grav;
+                    out_y += ry * grav;
+                }
+            }
+
+            out_x.store(&out.x[l]);
+            out_y.store(&out.y[l]);
+        }
+
+        return out;
+    }
+}
+
+// Planets is FixedPlanets<N>, or PlanetArrays for any other count. The
+// system has to outlive the field.
+template <typename Planets, bool Angular>
+class ExactField {
+    System const* system;
+    Planets planets;
+
+public:
+    explicit ExactField(System const& system)
+        : system(&system), planets(system.planetArrays()) {}
+
+    // Single probes are not worth specializing, they are the System's
+    point probeTotalGradient(point const& pos, const float angular_factor) const {
+        return system->probeTotalGradient(pos, angular_factor);
+    }
+
+    PointBatch probeTotalGradient(PointBatch const& pos, const float angular_factor) const {
+        return kernels::totalGradient<Angular>(planets, pos, angular_factor);
+    }
+
+    point probeLaneTotalGradient(point const& pos, const float angular_factor) const {
+        return kernels::laneTotalGradient<Angular>(planets, pos, angular_factor);
+    }
+};
+
+namespace detail {
+    // Tries the planet counts one after the other
+    template <bool Angular, std::size_t... Counts>
+    struct FixedPlanetDispatch;
+
+    template <bool Angular>
+    struct FixedPlanetDispatch<Angular> {
+        template <typename Func>
+        static void run(System const& system, Func&& func) {
+            func(ExactField<PlanetArrays, Angular>(system));
+        }
+    };
+
+    template <bool Angular, std::size_t N, std::size_t... Rest>
+    struct FixedPlanetDispatch<Angular, N, Rest...> {
+        template <typename Func>
+        static void run(System const& system, Func&& func) {
+            if (system.planets().size() == N) {
+                func(ExactField<FixedPlanets<N>, Angular>(system));
+            } else {
+                FixedPlanetDispatch<Angular, Rest...>::run(system, func);
+            }
+        }
+    };
+
+    // The planet counts with a kernel of their own
+    template <bool Angular>
+    using PresetDispatch = FixedPlanetDispatch<Angular, 8, 10, 12, 16>;
+}
+
+// Calls func with the exact field of system, specialized for its number of
+// planets and for whether spiral_factor leaves an angular term.
+template <typename Func>
+void withExactField(System const& system, const float spiral_factor, Func&& func) {
+    if (spiral_factor != 0) {
+        detail::PresetDispatch<true>::run(system, func);
+    } else {
+        detail::PresetDispatch<false>::run(system, func);
+    }
+}
+
+#endif // EXACT_FIELD_HPP
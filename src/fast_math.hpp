@@ -0,0 +1,83 @@
+#ifndef FAST_MATH_HPP
+#define FAST_MATH_HPP
+
+#include <cmath>
+#include "simd.hpp"
+
+// Inverse square roots for the field kernels and the glider steps, where
+// divisions and square roots make up a good part of the instructions.
+// GLIDERS_FAST_MATH picks how they are taken:
+//
+//   0  exact divisions and square roots, the default
+//   1  the hardware estimate refined with a Newton-Raphson step, a
+//      relative error of a few 1e-7
+//   2  only the hardware estimate, a relative error of up to about 4e-4
+//
+// Anything but 0 changes the trajectories slightly, and with them which
+// path comes out as the nice one.
+
+#ifndef GLIDERS_FAST_MATH
+#define GLIDERS_FAST_MATH 0
+#endif
+
+namespace fastmath {
+    const int level = GLIDERS_FAST_MATH;
+
+    inline simd::vfloat rsqrt(const simd::vfloat x) {
+        using simd::vfloat;
+        if (level == 0) return vfloat(1.f) / sqrt(x);
+
+        const vfloat r = rsqrtEstimate(x);
+        if (level >= 2) return r;
+        return r * (vfloat(1.5f) - vfloat(0.5f) * x * r * r);
+    }
+
+    // The same estimate as the vector one, so that a glider integrated on
+    // its own takes the same path as in a batch
+    inline float rsqrt(const float x) {
+        if (level == 0) return 1.f / std::sqrt(x);
+
+        const float r = simd::rsqrtEstimate(x);
+        if (level >= 2) return r;
+        return r * (1.5f - 0.5f * x * r * r);
+    }
+
+    // 1 / sq and 1 / sqrt(sq) of a squared distance sq. The exact version
+    // is the one the kernels always used, 1 / sq and then its root.
+    template <typename Float>
+    void inverseSquare(const Float sq, Float& inv_sq, Float& inv_dist) {
+        if (level == 0) {
+            inv_sq = Float(1.f) / sq;
+            using std::sqrt;
+            inv_dist = sqrt(inv_sq);
+        } else {
+            inv_dist = rsqrt(sq);
+            inv_sq = inv_dist * inv_dist;
+        }
+    }
+
+    // m / sq^(3/2), m / sq and m / sqrt(sq), as the kernels wrote them
+    template <typename Float>
+    Float overDistanceCubed(const Float m, const Float sq) {
+        using std::sqrt;
+        if (level == 0) return m / (sq * sqrt(sq));
+        const Float r = rsqrt(sq);
+        return m * r * r * r;
+    }
+
+    template <typename Float>
+    Float overDistanceSquared(const Float m, const Float sq) {
+        if (level == 0) return m / sq;
+        const Float r = rsqrt(sq);
+        return m * r * r;
+    }
+
+    template <typename Float>
+    Float overDistance(const Float m, const Float sq) {
+        using std::sqrt;
+        if (level == 0) return m / sqrt(sq);
+        return m * rsqrt(sq);
+    }
+}
+
+#endif // FAST_MATH_HPP
@@ -0,0 +1,68 @@
+#ifndef FIELD_BACKEND_HPP
+#define FIELD_BACKEND_HPP
+
+#include <array>
+#include <iostream>
+#include <string>
+#include "barnes_hut.hpp"
+#include "exact_field.hpp"
+#include "field_grid.hpp"
+#include "point.hpp"
+#include "system.hpp"
+
+// The fields the gliders can be integrated through. exact is the sum over
+// all planets, through the vectorized kernels specialized for the planet
+// count where there is one, see exact_field.hpp. field_grid and barnes_hut
+// approximate it faster for many planets or many gliders.
+
+enum class Backend {
+    exact, field_grid, barnes_hut
+};
+
+inline std::istream& operator>>(std::istream& in, Backend& backend) {
+    std::string name;
+    in >> name;
+    if (name == "exact") backend = Backend::exact;
+    else if (name == "grid") backend = Backend::field_grid;
+    else if (name == "barnes-hut") backend = Backend::barnes_hut;
+    else in.setstate(std::ios::failbit);
+    return in;
+}
+
+inline std::ostream& operator<<(std::ostream& out, const Backend backend) {
+    switch (backend) {
+    case Backend::exact: return out << "exact";
+    case Backend::field_grid: return out << "grid";
+    case Backend::barnes_hut: return out << "barnes-hut";
+    }
+    return out;
+}
+
+struct BackendOptions {
+    // Node spacing of the field grid
+    float grid_resolution = 4.f;
+    // Opening angle of the Barnes-Hut tree
+    float theta = 0.5f;
+};
+
+// Builds the field of backend for system and calls func(field) with it
+template <typename Func>
+void withBackend(const Backend backend, BackendOptions const& options, System const& system,
+                 std::array<point, 2> const& bounds, const float spiral_factor, Func&& func) {
+    switch (backend) {
+    case Backend::field_grid: {
+        const FieldGrid grid(system, bounds, options.grid_resolution);
+        func(grid);
+        break;
+    }
+    case Backend::barnes_hut: {
+        const BarnesHut tree(system, options.theta);
+        func(tree);
+        break;
+    }
+    default:
+        withExactField(system, spiral_factor, func);
+    }
+}
+
+#endif // FIELD_BACKEND_HPP
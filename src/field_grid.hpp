@@ -0,0 +1,192 @@
+#ifndef FIELD_GRID_HPP
+#define FIELD_GRID_HPP
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "point.hpp"
+#include "point_batch.hpp"
+#include "fast_math.hpp"
+#include "parallel.hpp"
+#include "profile.hpp"
+#include "system.hpp"
+
+// The planets never move, so the gradient fields can be sampled once on a
+// regular grid and then interpolated, making a probe cost independent of
+// the number of planets. The gravitational and angular gradients are
+// stored separately, so the angular factor can still be chosen per probe.
+//
+// Near a planet the field is singular and no interpolation gets it right.
+// Instead of sampling the field itself, the grid samples a softened
+// version where every planet's |r| is clamped to at least
+// softening_radius. That is smooth everywhere, and differs from the exact
+// field only within softening_radius of a planet. A probe interpolates the
+// softened field and then adds back the exact difference for the few
+// planets close enough to matter, which each cell keeps a list of.
+// Outside of the grid, the exact sum over all planets is used.
+
+class FieldGrid {
+    System const* system;
+
+    point origin;
+    float resolution;
+    float sq_softening;
+    float inv_softening_sq, inv_softening_cube;
+    std::size_t nx, ny; // number of nodes, cells are indexed like their lower left node
+
+    // Per node: the softened -probeGravity and probeAngularPotentialGradient,
+    // interleaved so that one interpolation tap is one contiguous load.
+    struct Node {
+        float grav_x, grav_y, ang_x, ang_y;
+    };
+    std::vector<Node> nodes;
+
+    // Per cell: planets within softening_radius of it, in CSR layout
+    std::vector<std::uint32_t> near_offsets;
+    std::vector<std::uint32_t> near_planets;
+
+    std::size_t node(const std::size_t ix, const std::size_t iy) const { return iy * nx + ix; }
+
+    static std::array<float, 4> catmullRomWeights(const float t) {
+        const float t2 = t * t;
+        const float t3 = t2 * t;
+        return {{(-t3 + 2 * t2 - t) / 2,
+                 (3 * t3 - 5 * t2 + 2) / 2,
+                 (-3 * t3 + 4 * t2 + t) / 2,
+                 (t3 - t2) / 2}};
+    }
+
+    void buildNearLists(const float softening_radius) {
+        std::vector<std::vector<std::uint32_t>> lists(nx * ny);
+
+        for (std::size_t i = 0; i < system->planets().size(); ++i) {
+            const point rel = (system->planets()[i].pos - origin) / resolution;
+            const float r = softening_radius / resolution;
+            const long x0 = std::max(0l, static_cast<long>(std::floor(rel.x - r)));
+            const long y0 = std::max(0l, static_cast<long>(std::floor(rel.y - r)));
+            const long x1 = std::min(static_cast<long>(nx) - 1, static_cast<long>(std::floor(rel.x + r)));
+            const long y1 = std::min(static_cast<long>(ny) - 1, static_cast<long>(std::floor(rel.y + r)));
+            for (long iy = y0; iy <= y1; ++iy) {
+                for (long ix = x0; ix <= x1; ++ix) {
+                    lists[node(ix, iy)].push_back(i);
+                }
+            }
+        }
+
+        near_offsets.assign(1, 0);
+        near_planets.clear();
+        for (auto const& l : lists) {
+            near_planets.insert(near_planets.end(), l.begin(), l.end());
+            near_offsets.push_back(near_planets.size());
+        }
+    }
+
+public:
+    // resolution is the node spacing in the units of bounds, the smaller the
+    // closer to the exact field. The softening radius should be a few times
+    // the resolution, so the softened field is well resolved. The grid
+    // extends a few nodes past bounds, so gliders leaving the bounds briefly
+    // are still interpolated.
+    FieldGrid(System const& system, std::array<point, 2> const& bounds,
+              const float resolution = 4.f, const float softening_radius = 16.f,
+              const unsigned nr_threads = 0)
+        : system(&system), resolution(resolution),
+          sq_softening(softening_radius * softening_radius),
+          inv_softening_sq(1 / sq_softening),
+          inv_softening_cube(inv_softening_sq / softening_radius) {
+        profile::ScopedTimer timer ("build field grid");
+        const float margin = 3 * resolution;
+        origin = bounds[0] - point(margin, margin);
+        nx = static_cast<std::size_t>(std::ceil((bounds[1].x - bounds[0].x + 2 * margin) / resolution)) + 1;
+        ny = static_cast<std::size_t>(std::ceil((bounds[1].y - bounds[0].y + 2 * margin) / resolution)) + 1;
+
+        nodes.resize(nx * ny);
+
+        parallel::forEach(ny, [&](unsigned, const std::size_t iy) {
+            for (std::size_t ix = 0; ix < nx; ++ix) {
+                const point p = origin + point(ix * resolution, iy * resolution);
+                point g, a;
+                kernels::softenedGradients(system.planetArrays(), p, softening_radius, g, a);
+                nodes[node(ix, iy)] = {g.x, g.y, a.x, a.y};
+            }
+        }, nr_threads);
+
+        buildNearLists(softening_radius);
+    }
+
+    System const& exactSystem() const { return *system; }
+
+    // Same as System::probeTotalGradient, up to interpolation error.
+    point probeTotalGradient(point const& pos, const float angular_factor) const {
+        const point rel = (pos - origin) / resolution;
+        const float fx = std::floor(rel.x);
+        const float fy = std::floor(rel.y);
+
+        // Needs nodes ix-1 .. ix+2 and the same for y
+        if (!(fx >= 1 && fy >= 1 && fx < nx - 2 && fy < ny - 2)) {
+            return system->probeTotalGradient(pos, angular_factor);
+        }
+
+        const std::size_t ix = static_cast<std::size_t>(fx);
+        const std::size_t iy = static_cast<std::size_t>(fy);
+
+        const auto wx = catmullRomWeights(rel.x - fx);
+        const auto wy = catmullRomWeights(rel.y - fy);
+
+        float gx = 0, gy = 0, ax = 0, ay = 0;
+        for (std::size_t j = 0; j < 4; ++j) {
+            const std::size_t row = node(ix - 1, iy - 1 + j);
+            float rgx = 0, rgy = 0, rax = 0, ray = 0;
+            for (std::size_t i = 0; i < 4; ++i) {
+                Node const& n = nodes[row + i];
+                rgx += wx[i] * n.grav_x;
+                rgy += wx[i] * n.grav_y;
+                rax += wx[i] * n.ang_x;
+                ray += wx[i] * n.ang_y;
+            }
+            gx += wy[j] * rgx;
+            gy += wy[j] * rgy;
+            ax += wy[j] * rax;
+            ay += wy[j] * ray;
+        }
+
+        // Exact minus softened contribution of the planets nearby
+        PlanetArrays const& planets = system->planetArrays();
+        const std::size_t cell = node(ix, iy);
+        for (std::size_t k = near_offsets[cell]; k < near_offsets[cell + 1]; ++k) {
+            const std::size_t i = near_planets[k];
+            const float rx = pos.x - planets.x[i];
+            const float ry = pos.y - planets.y[i];
+            const float sq = rx * rx + ry * ry;
+            if (sq >= sq_softening) continue;
+
+            float inv_sq, inv_dist;
+            fastmath::inverseSquare(sq, inv_sq, inv_dist);
+            const float grav = planets.g_mass[i] * (inv_sq * inv_dist - inv_softening_cube);
+            const float ang = planets.spin_mass[i] * (inv_sq - inv_softening_sq);
+            gx += rx * grav;
+            gy += ry * grav;
+            ax += ry * ang;
+            ay -= rx * ang;
+        }
+
+        return point(gx - angular_factor * ax, gy - angular_factor * ay);
+    }
+
+    PointBatch probeTotalGradient(PointBatch const& pos, const float angular_factor) const {
+        PointBatch out;
+        for (std::size_t l = 0; l < PointBatch::lanes; ++l) {
+            out.set(l, probeTotalGradient(pos[l], angular_factor));
+        }
+        return out;
+    }
+
+    // The batch probe is the single one for every lane
+    point probeLaneTotalGradient(point const& pos, const float angular_factor) const {
+        return probeTotalGradient(pos, angular_factor);
+    }
+};
+
+#endif // FIELD_GRID_HPP
@@ -1,26 +1,46 @@
 #include <boost/filesystem.hpp>
 #include <SFML/Window.hpp>
 #include <SFML/Graphics.hpp>
+#include <memory>
 #include <random>
 #include <sstream>
 #include <iomanip>
+#include <chrono>
+#include <map>
+#include <mutex>
 
 #include "point.hpp"
 #include "glider.hpp"
 #include "system.hpp"
+#include "field_grid.hpp"
+#include "barnes_hut.hpp"
+#include "exact_field.hpp"
+#include "field_backend.hpp"
+#include "headless.hpp"
+#include "seed_farm.hpp"
+#include "lru_cache.hpp"
+#include "params.hpp"
+#include "profile.hpp"
+#include "render.hpp"
+#include "search.hpp"
+#include "worker.hpp"
 
 
 
 // ##########   Main parameters ##################
 
-unsigned int height = 1000;
-unsigned int width = 1800;
+// Size, seed, planets, gliders, steps and spiral factor. The defaults are
+// in params.hpp, run with --help to see how to change them.
+Params params;
 
-int seed = 3;
-const std::size_t nr_planets = 10;
-const std::size_t nr_gliders = 1000;
-const std::size_t max_steps = 200;
-const float spiral_factor = 4.0f;
+// Integrate the trajectories with adaptive step sizes, toggled with D,
+// keeping the error of every step below params.adaptive_tolerance pixels
+bool adaptive_integration = false;
+// Number of recent seeds whose planets, trajectories and plots are kept
+const std::size_t scene_cache_size = 8;
+// Gliders are computed in the background and shown progressively: this
+// many first, and then twice as many with every chunk
+const std::size_t first_trajectory_chunk = 64;
 
 // ##############################################
 
@@ -32,7 +52,7 @@ const float spiral_factor = 4.0f;
 
 void drawPlanets(sf::RenderWindow& win, System const& system) {
     const sf::Color planet_color(100, 100, 100);
-    for (auto const& p:system.planets) {
+    for (auto const& p:system.planets()) {
         float radius = sqrt(p.mass) * 10.f;
         sf::CircleShape planet(radius);
         planet.setFillColor(planet_color);
@@ -41,72 +61,97 @@ void drawPlanets(sf::RenderWindow& win, System const& system) {
     }
 }
 
-void drawSingleTrajectory(sf::RenderWindow& win,
-                          System const& system,
-                          point const& start_pos,
-                          const std::size_t max_steps,
-                          std::array<point, 2> const& bounds,
-                          sf::Color const& glider_color = sf::Color(255, 255, 255, 20),
-                          const bool print_score = false) {
-    const auto points = generateGliderTrajectory(start_pos, system, spiral_factor, max_steps);
-
-    if (print_score) {
-        std::cout << "path score: " << scorePath(system, bounds, points) << "\n";
-    }
-    
-    std::vector<sf::Vertex> vertices;
+void drawTrajectory(sf::RenderWindow& win,
+                    PointSpan points,
+                    sf::Color const& glider_color) {
+    // Kept between calls, the viewer only draws from the main thread
+    static std::vector<sf::Vertex> vertices;
+    vertices.clear();
     
     for (auto const& p:points) {
         vertices.emplace_back(sf::Vector2f(p.x, p.y), glider_color);
     }
 
-    win.draw(&vertices[0], vertices.size(), sf::LinesStrip);
+    win.draw(vertices.data(), vertices.size(), sf::LinesStrip);
 }
 
-void drawTrajectories(sf::RenderWindow& win,
-                      System const& system, const std::size_t nr_gliders, const int seed,
-                      std::array<point, 2> const& bounds, const std::size_t max_steps) {
 
-    // offset the seed because otherwise, we might get the same points as we did for
-    // the planets, which would not be very helpful.
-    std::mt19937 rng (seed + 1000);
+template <typename Field>
+std::vector<std::vector<point>> generateTrajectoriesWith(const integrator::Method method,
+                                                         std::vector<GliderStart> const& starts,
+                                                         Field const& field,
+                                                         const std::size_t max_steps) {
+    std::vector<std::vector<point>> paths;
+    integrator::withMethod(method, [&](auto step) {
+        paths = generateGliderTrajectories<decltype(step)>(starts, field, params.spiral_factor,
+                                                           max_steps, params.nr_threads);
+    });
+    return paths;
+}
 
-    // drawPlanets(win, system);
+// Integrates the gliders in chunks that double in size, and hands every
+// finished chunk to emit(paths), so a coarse picture shows up right away and
+// then fills in. Stops early once cancelled is set, or when time_budget
+// seconds have passed (0 for no limit). Returns the number of gliders that
+// made it.
+template <typename Field, typename Emit>
+std::size_t streamTrajectories(Field const& field, std::vector<GliderStart> const& starts,
+                               const std::size_t max_steps, const bool adaptive,
+                               const float time_budget,
+                               BackgroundWorker::Cancelled const& cancelled, Emit&& emit) {
+    const auto start_time = std::chrono::steady_clock::now();
+    auto out_of_time = [&] {
+        const std::chrono::duration<float> elapsed = std::chrono::steady_clock::now() - start_time;
+        return time_budget > 0 && elapsed.count() > time_budget;
+    };
 
-    for (std::size_t i = 0; i < nr_gliders; ++i) {
-        const point p = point::randomPoint(bounds, rng);
-        drawSingleTrajectory(win, system, p, max_steps, bounds);
+    std::size_t first = 0;
+    while (first < starts.size() && !cancelled && !out_of_time()) {
+        const std::size_t chunk_size = std::max(first_trajectory_chunk, first);
+        const std::size_t last = std::min(starts.size(), first + chunk_size);
+        const std::vector<GliderStart> chunk(starts.begin() + first, starts.begin() + last);
+
+        emit(adaptive
+             ? generateAdaptiveGliderTrajectories(chunk, field, params.spiral_factor,
+                                                  max_steps * glider_stepsize,
+                                                  params.adaptive_tolerance, params.nr_threads)
+             : generateTrajectoriesWith(params.step_method, chunk, field, max_steps));
+        first = last;
     }
+
+    return first;
 }
 
-void drawPotentialPlot(sf::RenderWindow& win,
-                       System const& system,
-                       std::array<point,2> const& bounds, const float resolution = 2.f) {
-    const sf::Vector2f tile_size (resolution, resolution);
-    
-    for (float x = bounds[0].x; x <= bounds[1].x - resolution; x += resolution) {
-        for (float y = bounds[0].y; y <= bounds[1].y - resolution; y += resolution) {
-            const point p (x + resolution / 2, y + resolution / 2);
-            const float normalized_potential = -(system.probePotential(p)) / 100.f;
-            const uint8_t value = 255.f * fmod(200.0 * normalized_potential, 1.0);
-            const sf::Color color(value, value, value);
-            sf::RectangleShape tile(tile_size);
-            tile.setFillColor(color);
-            tile.setPosition(x, y);
-            win.draw(tile);
-        }
+// Dots and direction lines of a vector field plot, kept so that the plot
+// can be drawn again without probing the field.
+struct VectorFieldLayer {
+    std::vector<sf::Vertex> dots;
+    std::vector<sf::Vertex> lines;
+
+    void draw(sf::RenderTarget& target) const {
+        target.draw(dots.data(), dots.size(), sf::Triangles);
+        target.draw(lines.data(), lines.size(), sf::Lines);
     }
-}
+};
 
 template<typename VectorFieldFunc>
-void drawVectorField(sf::RenderWindow& win,
-                     VectorFieldFunc func,
-                     std::array<point, 2> const& bounds,
-                     const float resolution = 16.f) {
+VectorFieldLayer plotVectorField(VectorFieldFunc func,
+                                 std::array<point, 2> const& bounds,
+                                 const float resolution = 16.f) {
     const sf::Color dot_color (200, 125, 120);
     const float dot_radius = 1.6f;
 
-    std::vector<sf::Vertex> lines;
+    // Dots are small octagons, all in one triangle list
+    const int dot_corners = 8;
+    std::array<sf::Vector2f, dot_corners> dot_shape;
+    for (int i = 0; i < dot_corners; ++i) {
+        const float angle = 2 * M_PI * i / dot_corners;
+        dot_shape[i] = sf::Vector2f(dot_radius * std::cos(angle), dot_radius * std::sin(angle));
+    }
+
+    VectorFieldLayer layer;
+    auto& lines = layer.lines;
+    auto& dots = layer.dots;
     
     for (float x = bounds[0].x; x <= bounds[1].x - resolution; x += resolution) {
         for (float y = bounds[0].y; y <= bounds[1].y - resolution; y += resolution) {
@@ -116,60 +161,499 @@ void drawVectorField(sf::RenderWindow& win,
             lines.emplace_back(sf::Vector2f(p.x, p.y));
             lines.emplace_back(sf::Vector2f(p.x + vec.x, p.y + vec.y));
 
-            sf::CircleShape dot(dot_radius);
-            dot.setFillColor(dot_color);
-            dot.setPosition(p.x - dot_radius, p.y - dot_radius);
-            win.draw(dot);
+            const sf::Vector2f centre (p.x, p.y);
+            for (int i = 0; i < dot_corners; ++i) {
+                dots.emplace_back(centre, dot_color);
+                dots.emplace_back(centre + dot_shape[i], dot_color);
+                dots.emplace_back(centre + dot_shape[(i + 1) % dot_corners], dot_color);
+            }
         }
     }
 
-    win.draw(&lines[0], lines.size(), sf::Lines);
+    return layer;
 }
 
-void saveScreenshot(sf::RenderWindow& win, const int seed) {
+// The gliders of one backend and integration, as they come in. Only the
+// paths are kept, a TrajectoryCanvas draws them.
+struct TrajectoryLayer {
+    std::vector<std::vector<point>> paths;
+    // Tells the canvas that the paths were started over
+    std::uint64_t id = 0;
+    // False while the gliders are still coming in, or if that got cancelled
+    bool complete = false;
+
+    void reset() {
+        static std::uint64_t next_id = 0;
+        paths.clear();
+        id = ++next_id;
+        complete = false;
+    }
+
+    void add(std::vector<std::vector<point>> paths_chunk) {
+        for (auto& points : paths_chunk) paths.push_back(std::move(points));
+    }
+};
+
+// A single texture for the trajectory layers of all seeds, so showing the
+// gliders is a single sprite no matter how many there are. It holds the
+// layer that was shown last, new gliders of that one are drawn on top, and
+// any other layer is drawn again from its paths.
+class TrajectoryCanvas {
+    sf::RenderTexture texture;
+    std::uint64_t layer_id = 0;
+    std::size_t nr_drawn = 0;
+
+public:
+    TrajectoryCanvas(const unsigned width, const unsigned height) {
+        sf::ContextSettings settings;
+        settings.antialiasingLevel = 8;
+        texture.create(width, height, settings);
+    }
+
+    // scratch is only used to draw the paths in one go
+    sf::Texture const& show(TrajectoryLayer const& layer, TrajectoryBatch& scratch) {
+        if (layer.id != layer_id || nr_drawn > layer.paths.size()) {
+            texture.clear(sf::Color(30, 30, 30));
+            layer_id = layer.id;
+            nr_drawn = 0;
+        }
+        if (nr_drawn < layer.paths.size()) {
+            profile::ScopedTimer timer ("draw trajectory chunk");
+            scratch.clear();
+            for (std::size_t i = nr_drawn; i < layer.paths.size(); ++i) {
+                scratch.add(layer.paths[i], sf::Color(255, 255, 255, 20));
+            }
+            scratch.draw(texture);
+            nr_drawn = layer.paths.size();
+        }
+        texture.display();
+        return texture.getTexture();
+    }
+};
+
+// Everything that is drawn for one seed. Every part is made the first time
+// it is shown, so switching views, toggling the nice path or coming back to
+// a recent seed only draws cached layers again.
+//
+// The expensive parts are computed by background jobs, which only read the
+// system and the backends, and post their results back to the main thread.
+// Everything else is only touched from the main thread.
+struct SeedScene {
+    System system;
+
+    std::mutex backend_mutex;
+    std::unique_ptr<FieldGrid> field_grid;
+    std::unique_ptr<BarnesHut> barnes_hut;
+
+    // All gliders, by backend and adaptive integration
+    std::map<std::pair<Backend, bool>, TrajectoryLayer> trajectories;
+    // The few gliders drawn over the field plots
+    std::unique_ptr<TrajectoryBatch> overlay;
+    // Nice paths by backend and nice path seed
+    std::map<std::pair<Backend, int>, std::vector<point>> nice_paths;
+
+    std::unique_ptr<sf::RenderTexture> potential;
+    std::unique_ptr<VectorFieldLayer> gravity, angular_gradient;
+
+    template <typename RNG>
+    SeedScene(const std::size_t nr_planets, std::array<point, 2> const& bounds, RNG& rng)
+        : system(nr_planets, bounds, rng) {}
+
+    // Calls func with the backend, which is built on first use. Safe to
+    // call from several threads.
+    template <typename Func>
+    void withField(const Backend backend, std::array<point, 2> const& bounds, Func&& func) {
+        if (backend == Backend::field_grid) {
+            FieldGrid* grid;
+            {
+                std::lock_guard<std::mutex> lock(backend_mutex);
+                if (!field_grid) {
+                    field_grid.reset(new FieldGrid(system, bounds,
+                                                   params.backend_options.grid_resolution));
+                }
+                grid = field_grid.get();
+            }
+            func(*grid);
+        } else if (backend == Backend::barnes_hut) {
+            BarnesHut* tree;
+            {
+                std::lock_guard<std::mutex> lock(backend_mutex);
+                if (!barnes_hut) {
+                    barnes_hut.reset(new BarnesHut(system, params.backend_options.theta));
+                }
+                tree = barnes_hut.get();
+            }
+            func(*tree);
+        } else {
+            func(system);
+        }
+    }
+};
+
+// One bar per phase, its length the time spent in that phase, in the order
+// the phases first ran. Without a font at hand the numbers go into the
+// window title.
+void drawProfileOverlay(sf::RenderWindow& win, profile::Summary const& summary) {
+    const float bar_height = 8.f, gap = 4.f, max_width = 300.f;
+    const std::array<sf::Color, 6> colors {{
+        sf::Color(230, 85, 70), sf::Color(90, 170, 230), sf::Color(120, 200, 90),
+        sf::Color(230, 190, 60), sf::Color(180, 110, 220), sf::Color(90, 210, 190)
+    }};
+
+    double longest = 0;
+    for (auto const& phase : summary.phases) longest = std::max(longest, phase.seconds);
+
+    sf::RectangleShape panel(sf::Vector2f(max_width + 2 * gap,
+                                          summary.phases.size() * (bar_height + gap) + gap));
+    panel.setFillColor(sf::Color(0, 0, 0, 160));
+    win.draw(panel);
+
+    std::stringstream title;
+    title << std::fixed << std::setprecision(1);
+    for (std::size_t i = 0; i < summary.phases.size(); ++i) {
+        auto const& phase = summary.phases[i];
+        const float width = longest > 0 ? max_width * phase.seconds / longest : 0.f;
+        sf::RectangleShape bar(sf::Vector2f(std::max(width, 1.f), bar_height));
+        bar.setPosition(gap, gap + i * (bar_height + gap));
+        bar.setFillColor(colors[i % colors.size()]);
+        win.draw(bar);
+
+        title << (i ? ", " : "") << phase.name << ' ' << phase.seconds * 1000 << "ms";
+    }
+    title << " | " << summary.counters[static_cast<std::size_t>(profile::Counter::steps)]
+          << " steps";
+    win.setTitle(title.str());
+}
+
+// First <screenshot_dir>/glider_<seed>_<i>.<extension> that does not exist yet
+std::string screenshotPath(const int seed, const char* extension) {
     namespace fs = boost::filesystem;
 
-    auto const screenshot_dir = fs::current_path() / "screenshots";
+    auto const screenshot_dir = fs::current_path() / params.screenshot_dir;
 
     if (!fs::exists(screenshot_dir)) {
-        fs::create_directory(screenshot_dir);
+        fs::create_directories(screenshot_dir);
     }
 
-    auto mkpath = [&screenshot_dir, seed](const std::size_t i) {
+    auto mkpath = [&screenshot_dir, seed, extension](const std::size_t i) {
         std::stringstream name;
         name << "glider_" << seed << '_';
         name << std::setfill('0') << std::setw(4) << i;
-        name << ".png";
+        name << '.' << extension;
 
         return screenshot_dir / name.str();
     };
 
     std::size_t i = 0;
     while (fs::exists(mkpath(i))) ++i;
+    return mkpath(i).string();
+}
 
+void saveScreenshot(sf::RenderWindow& win, const int seed) {
     sf::Texture texture;
-    texture.create(width, height);
+    texture.create(params.width, params.height);
     texture.update(win, 0, 0);
     sf::Image screenshot = texture.copyToImage();
-    screenshot.saveToFile(mkpath(i).string());
+    screenshot.saveToFile(screenshotPath(seed, "png"));
 }
 
-int main() {
+// The gliders of layer as an SVG, with nice_path on top if it is not empty.
+// They are finished already, so this only simplifies and writes them.
+void saveSvg(const int seed, TrajectoryLayer const& layer, std::vector<point> const& nice_path) {
+    const std::string path = screenshotPath(seed, "svg");
+    const bool ok = writeTrajectorySvg(params, layer.paths, nice_path, path);
+    std::cout << (ok ? "wrote " : "failed to write ") << path << '\n';
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        if (!parseCommandLine(argc, argv, params)) return 0;
+    } catch (boost::program_options::error const& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+
+    if (params.farm_port != 0) return farm::runCoordinator(params);
+    if (!params.farm_worker.empty()) return farm::runWorker(params);
+
+    if (params.headless) {
+        if (params.frames > 0) return runSweep(params) == 0 ? 0 : 1;
+        return runHeadless(params) == 0 ? 0 : 1;
+    }
+
+    int& seed = params.seed;
+    const std::size_t nr_planets = params.nr_planets;
+    const std::size_t nr_gliders = params.nr_gliders;
+    const std::size_t max_steps = params.max_steps;
+    const float spiral_factor = params.spiral_factor;
+
     sf::ContextSettings settings;
     settings.antialiasingLevel = 8;
-    sf::RenderWindow win(sf::VideoMode(width, height), "Loren's Asteroid Gliders",
+    sf::RenderWindow win(sf::VideoMode(params.width, params.height), "Loren's Asteroid Gliders",
                          sf::Style::Default, settings);
-    std::array<point, 2> bounds {point(0.f, 0.f), point((float)width, (float)height)};
+    const std::array<point, 2> bounds = imageBounds(params);
+
+    LruCache<int, SeedScene> scenes(scene_cache_size);
+    auto scene_for = [&](const int s) {
+        return scenes.get(s, [&] {
+            std::mt19937 rng(s);
+            return std::make_shared<SeedScene>(nr_planets, bounds, rng);
+        });
+    };
+
+    Backend backend = params.backend;
+    adaptive_integration = params.adaptive;
+    auto toggle_backend = [&](const Backend b, const char* name) {
+        backend = backend == b ? Backend::exact : b;
+        std::cout << name << ": " << (backend == b ? "on" : "off") << '\n';
+    };
 
-    std::mt19937 rng(seed);
-    System system(nr_planets, bounds, rng);
+    PotentialPlot potential_plot;
 
     enum class Display {
         trajectories, potential, gravity, angular_gradient
     } display = Display::trajectories;
     bool redraw = true;
+    bool dirty = false;
     bool draw_nice_path = false;
     int nice_path_seed = 1;
+    // Trajectories started with the mouse, until the next redraw
+    std::vector<std::vector<point>> clicked_paths;
+    // Timings of everything since the last redraw, toggled with I
+    bool show_profile = false;
+    profile::Mark profile_mark = profile::mark();
+
+    TrajectoryCanvas trajectory_canvas(params.width, params.height);
+    // Draws the new gliders of a chunk onto the canvas
+    TrajectoryBatch chunk_batch;
+
+    // Declared last, so it stops before anything its jobs use goes away
+    BackgroundWorker worker;
+
+    // Starts a background job for whatever the current view still misses
+    // in the cache, which replaces the previous job.
+    auto start_jobs = [&] {
+        std::shared_ptr<SeedScene> scene = scene_for(seed);
+        const int job_seed = seed;
+        const Backend job_backend = backend;
+
+        switch (display) {
+        case Display::trajectories:
+            {
+                const auto key = std::make_pair(backend, adaptive_integration);
+                const auto nice_key = std::make_pair(backend, nice_path_seed);
+                TrajectoryLayer& layer = scene->trajectories[key];
+                const bool need_trajectories = !layer.complete;
+                const bool need_nice_path = draw_nice_path && !scene->nice_paths.count(nice_key);
+                if (need_trajectories) layer.reset();
+                if (!need_trajectories && !need_nice_path) {
+                    worker.cancel();
+                    break;
+                }
+
+                worker.start([&, scene, key, nice_key, job_seed, job_backend,
+                              need_trajectories, need_nice_path]
+                             (BackgroundWorker::Cancelled const& cancelled) {
+                    profile::ScopedTimer timer ("trajectory job");
+                    auto stream = [&](auto const& field) {
+                        const auto starts =
+                            gliderStarts(nr_gliders, job_seed, bounds, params.sampling);
+                        const std::size_t done =
+                            streamTrajectories(field, starts, max_steps, key.second,
+                                               params.time_budget, cancelled,
+                                               [&](std::vector<std::vector<point>> paths) {
+                            worker.post(cancelled,
+                                        [scene, key, paths = std::move(paths)]() mutable {
+                                scene->trajectories[key].add(std::move(paths));
+                            });
+                        });
+                        if (cancelled) return;
+                        if (done < starts.size()) {
+                            printLine("Time budget used up after " + std::to_string(done) +
+                                      " gliders");
+                        }
+                        worker.post(cancelled, [scene, key] {
+                            scene->trajectories[key].complete = true;
+                        });
+                    };
+
+                    if (need_trajectories) {
+                        // The exact field is specialized for the system
+                        if (job_backend == Backend::exact) {
+                            withExactField(scene->system, spiral_factor, stream);
+                        } else {
+                            scene->withField(job_backend, bounds, stream);
+                        }
+                    }
+                    if (cancelled) return;
+
+                    scene->withField(job_backend, bounds, [&](auto const& field) {
+                        if (need_nice_path) {
+                            const size_t nice_path_length = max_steps;
+                            const auto cache_key = nicePathKey(
+                                job_seed, nice_key.second, nr_planets, nice_path_length,
+                                spiral_factor, bounds, params.search,
+                                params.nice_path_attempts,
+                                static_cast<std::uint32_t>(job_backend),
+                                job_backend == Backend::field_grid
+                                    ? params.backend_options.grid_resolution : 0.f,
+                                job_backend == Backend::barnes_hut
+                                    ? params.backend_options.theta : 0.f);
+                            // Not through get(), a cancelled search must not
+                            // end up in the cache
+                            NicePathCache& cache = nicePathCache(params);
+                            NicePath nice_path;
+                            if (cache.find(cache_key, nice_path)) {
+                                profile::count(profile::Counter::nice_path_cache_hits);
+                            } else {
+                                nice_path = findNicePath(scene->system, field, spiral_factor,
+                                                         nice_path_length, bounds,
+                                                         nice_key.second, params.search,
+                                                         params.nr_threads,
+                                                         params.nice_path_attempts, &cancelled);
+                                if (cancelled) return;
+                                cache.insert(cache_key, nice_path);
+                            }
+                            std::ostringstream line;
+                            line << "found path with score " << nice_path.score;
+                            printLine(line.str());
+                            const auto points = generateGliderTrajectory(
+                                nice_path.start, field, spiral_factor, nice_path_length,
+                                nice_path.ccw);
+                            worker.post(cancelled, [scene, nice_key, points] {
+                                scene->nice_paths[nice_key] = points;
+                            });
+                        }
+                    });
+                });
+            }
+            break;
+        case Display::gravity:
+        case Display::angular_gradient:
+            {
+                const bool gravity = display == Display::gravity;
+                if (gravity ? scene->gravity : scene->angular_gradient) {
+                    worker.cancel();
+                    break;
+                }
+
+                worker.start([&, scene, gravity](BackgroundWorker::Cancelled const& cancelled) {
+                    profile::ScopedTimer timer ("vector field job");
+                    System const& system = scene->system;
+                    auto layer = std::make_shared<VectorFieldLayer>(gravity
+                        ? plotVectorField([&system](point const& p){
+                                return system.probeGravity(p);
+                            }, bounds)
+                        : plotVectorField([&system](point const& p){
+                                return system.probeAngularPotentialGradient(p);
+                            }, bounds));
+                    worker.post(cancelled, [scene, gravity, layer] {
+                        (gravity ? scene->gravity : scene->angular_gradient).reset(
+                            new VectorFieldLayer(std::move(*layer)));
+                    });
+                });
+            }
+            break;
+        case Display::potential:
+            // Drawn on the GPU when composing, if it can be
+            if (scene->potential || potential_plot.drawsWithShader(scene->system)) {
+                worker.cancel();
+                break;
+            }
+
+            worker.start([&, scene](BackgroundWorker::Cancelled const& cancelled) {
+                profile::ScopedTimer timer ("potential job");
+                auto pixels = std::make_shared<std::vector<sf::Uint8>>();
+                PotentialPlot::computePixels(scene->system, params.width, params.height,
+                                             *pixels, params.nr_threads, &cancelled);
+                if (cancelled) return;
+                worker.post(cancelled, [&, scene, pixels] {
+                    scene->potential.reset(new sf::RenderTexture);
+                    scene->potential->create(params.width, params.height);
+                    potential_plot.drawPixels(*scene->potential, *pixels);
+                    scene->potential->display();
+                });
+            });
+            break;
+        }
+    };
+
+    // Draws the current view from whatever is in the cache so far
+    auto compose = [&] {
+        profile::ScopedTimer timer ("compose");
+        win.clear(sf::Color(30, 30, 30));
+
+        std::shared_ptr<SeedScene> scene = scene_for(seed);
+        System const& system = scene->system;
+
+        // The exact field is used for the few gliders on top of the plots
+        auto draw_overlay = [&] {
+            profile::ScopedTimer overlay_timer ("draw overlay");
+            if (!scene->overlay) {
+                scene->overlay.reset(new TrajectoryBatch);
+                const BackgroundWorker::Cancelled never {false};
+                streamTrajectories(system, gliderStarts(10, seed, bounds, params.sampling),
+                                   max_steps, false, 0.f, never,
+                                   [&](std::vector<std::vector<point>> const& paths) {
+                    for (auto const& points : paths) {
+                        scene->overlay->add(points, sf::Color(255, 255, 255, 20));
+                    }
+                });
+            }
+            scene->overlay->draw(win);
+        };
+
+        switch (display) {
+        case Display::trajectories:
+            {
+                profile::ScopedTimer layer_timer ("draw trajectories");
+                auto found = scene->trajectories.find(std::make_pair(backend, adaptive_integration));
+                if (found != scene->trajectories.end()) {
+                    win.draw(sf::Sprite(trajectory_canvas.show(found->second, chunk_batch)));
+                }
+
+                auto nice_path = scene->nice_paths.find(std::make_pair(backend, nice_path_seed));
+                if (draw_nice_path && nice_path != scene->nice_paths.end()) {
+                    drawTrajectory(win, nice_path->second, sf::Color(255, 0, 0));
+                }
+            }
+            break;
+        case Display::potential:
+            // Otherwise the potential job makes it
+            if (!scene->potential && potential_plot.drawsWithShader(system)) {
+                profile::ScopedTimer layer_timer ("plot potential");
+                scene->potential.reset(new sf::RenderTexture);
+                scene->potential->create(params.width, params.height);
+                potential_plot.draw(*scene->potential, system);
+                scene->potential->display();
+            }
+            if (scene->potential) win.draw(sf::Sprite(scene->potential->getTexture()));
+            draw_overlay();
+            break;
+        case Display::gravity:
+            if (scene->gravity) {
+                profile::ScopedTimer layer_timer ("draw vector field");
+                scene->gravity->draw(win);
+            }
+            draw_overlay();
+            break;
+        case Display::angular_gradient:
+            if (scene->angular_gradient) {
+                profile::ScopedTimer layer_timer ("draw vector field");
+                scene->angular_gradient->draw(win);
+            }
+            draw_overlay();
+            break;
+        }
+
+        for (auto const& points : clicked_paths) {
+            drawTrajectory(win, points, sf::Color(255, 0, 0));
+        }
+
+        if (show_profile) drawProfileOverlay(win, profile::summarize(profile_mark));
+
+        win.display();
+    };
 
     while (win.isOpen()) {
         sf::Event event;
@@ -178,12 +662,20 @@ int main() {
             case sf::Event::MouseButtonPressed:
                 {
                     const point start_pos (event.mouseButton.x, event.mouseButton.y);
-                    drawSingleTrajectory(win, system, start_pos,
-                                         max_steps, bounds,
-                                         sf::Color(255, 0, 0), true);
-                    win.display();
+                    std::shared_ptr<SeedScene> scene = scene_for(seed);
+                    scene->withField(backend, bounds, [&](auto const& field) {
+                        clicked_paths.push_back(generateGliderTrajectory(
+                            start_pos, field, spiral_factor, max_steps, rand()&1));
+                    });
+                    std::cout << "path score: "
+                              << scorePath(scene->system, bounds, clicked_paths.back()) << "\n";
+                    dirty = true;
                 }
                 break;
+            case sf::Event::Resized:
+            case sf::Event::GainedFocus:
+                dirty = true;
+                break;
             case sf::Event::Closed:
                 win.close();
                 break;
@@ -222,6 +714,50 @@ int main() {
                 case sf::Keyboard::S:
                     saveScreenshot(win, seed);
                     break;
+                case sf::Keyboard::V:
+                    {
+                        std::shared_ptr<SeedScene> scene = scene_for(seed);
+                        auto layer = scene->trajectories.find(
+                            std::make_pair(backend, adaptive_integration));
+                        auto nice_path = scene->nice_paths.find(
+                            std::make_pair(backend, nice_path_seed));
+                        const bool has_nice_path = nice_path != scene->nice_paths.end();
+                        if (layer == scene->trajectories.end() || !layer->second.complete ||
+                            (draw_nice_path && !has_nice_path)) {
+                            std::cout << "The gliders are not done yet, "
+                                      << "show them with T and try again\n";
+                        } else {
+                            saveSvg(seed, layer->second, draw_nice_path
+                                    ? nice_path->second : std::vector<point>());
+                        }
+                    }
+                    break;
+                case sf::Keyboard::I:
+                    show_profile = !show_profile;
+                    if (show_profile) {
+                        if (!profile::enabled) {
+                            std::cout << "Profiling needs a build with GLIDERS_PROFILE\n";
+                        }
+                        profile::printSummary(std::cout, profile::summarize(profile_mark));
+                    } else {
+                        win.setTitle("Loren's Asteroid Gliders");
+                    }
+                    dirty = true;
+                    break;
+                case sf::Keyboard::C:
+                    toggle_backend(Backend::field_grid, "Cached field");
+                    redraw = true;
+                    break;
+                case sf::Keyboard::D:
+                    adaptive_integration = !adaptive_integration;
+                    std::cout << "Adaptive integration: "
+                              << (adaptive_integration ? "on" : "off") << '\n';
+                    redraw = true;
+                    break;
+                case sf::Keyboard::B:
+                    toggle_backend(Backend::barnes_hut, "Barnes-Hut");
+                    redraw = true;
+                    break;
                 case sf::Keyboard::N:
                     if (event.key.shift) {
                         --nice_path_seed;
@@ -241,44 +777,24 @@ int main() {
         }
 
         if (redraw) {
-            win.clear(sf::Color(30, 30, 30));
-
-            rng.seed(seed);
-            system = System(nr_planets, bounds, rng);
-            
-            switch (display) {
-            case Display::trajectories:
-                drawTrajectories(win, system, nr_gliders, seed, bounds, max_steps);
-
-                if (draw_nice_path) {
-                    const size_t nice_path_length = max_steps;
-                    const point nice_path_start =
-                        findNicePath(system, spiral_factor, nice_path_length,
-                                     bounds, nice_path_seed);
-
-                    drawSingleTrajectory(win, system, nice_path_start,
-                                         nice_path_length, bounds, sf::Color(255, 0, 0));
-                }
-                break;
-            case Display::potential:
-                drawPotentialPlot(win, system, bounds);
-                drawTrajectories(win, system, 10, seed, bounds, max_steps);
-                break;
-            case Display::gravity:
-                drawVectorField(win, [&system](point const& p){
-                        return system.probeGravity(p);
-                    }, bounds);
-                drawTrajectories(win, system, 10, seed, bounds, max_steps);
-                break;
-            case Display::angular_gradient:
-                drawVectorField(win, [&system](point const& p){
-                        return system.probeAngularPotentialGradient(p);
-                    }, bounds);
-                drawTrajectories(win, system, 10, seed, bounds, max_steps);
-                break;
-            }
-            win.display();
+            profile_mark = profile::mark();
+            clicked_paths.clear();
+            start_jobs();
             redraw = false;
+            dirty = true;
+        }
+
+        if (worker.runPosted() > 0) dirty = true;
+
+        if (dirty) {
+            compose();
+            dirty = false;
+        } else {
+            sf::sleep(sf::milliseconds(5));
         }
     }
+
+    if (!params.trace_file.empty() && !profile::writeChromeTrace(params.trace_file)) {
+        std::cerr << "failed to write " << params.trace_file << '\n';
+    }
 }
@@ -1,108 +1,533 @@
 #ifndef GLIDER_HPP
 #define GLIDER_HPP
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
 #include <limits>
+#include <string>
+#include <random>
 #include <vector>
 #include <Eigen/Dense>
 #include "system.hpp"
 #include "point.hpp"
+#include "point_batch.hpp"
+#include "glider_starts.hpp"
 #include "integrator.hpp"
+#include "nearest_planet.hpp"
+#include "parallel.hpp"
+#include "profile.hpp"
+#include "trajectory_pool.hpp"
+
+// Step size of the fixed step integration, which is also the length of a
+// step since the glider moves at unit speed.
+const float glider_stepsize = 10.f;
+
+// A glider stops once a step moves it less than the square root of the
+// lower limit, when it is stuck, or more than that of the upper one, when
+// it got flung off by a planet.
+const float sq_lower_dist_limit = 0.005f;
+const float sq_upper_dist_limit = 400.f;
+
+// Field can be System or any other backend offering the same
+// probeTotalGradient, like FieldGrid.
+template <typename Field>
+point equipotentialMotion(point const& pos, const float angular_potential_factor,
+                          Field const& field, const bool ccw) {
+    //
+    //             Glider               Resulting Motion
+    //   angle  <-- •              (for when ccw is true, flipped otherwise)   
+    //   gradient   |                      __
+    //              v gravity             |\                       .
+    //                                      \                      .
+    //              • Planet
+    //
+    //  We have two potentials in the space, the gravitational potential
+    //  and the angular potential. These potentials are summed up, where
+    //  the angular potential is first multiplied by a factor to control
+    //  its infulence.
+    //
+    //  To get a path where the total potential remains zero, we add the
+    //  gradients for both fields, and move in a direction perpendicular
+    //  to the gradient for this total potential. The field sums both
+    //  gradients in a single pass.
+
+    const point total_gradient =
+        field.probeTotalGradient(pos, angular_potential_factor);
+
+    const point equipot_motion = point(-total_gradient.y, total_gradient.x).norm();
+    return equipot_motion * (ccw ? 1 : -1);
+}
 
+template <typename Field>
 point gliderStep(point const& start_pos, const float angular_potential_factor,
-                       System const& system, const bool ccw) {
+                 Field const& field, const bool ccw) {
 
     auto gradient_func = [&](point const& pos){
-        //
-        //             Glider               Resulting Motion
-        //   angle  <-- •              (for when ccw is true, flipped otherwise)   
-        //   gradient   |                      __
-        //              v gravity             |\                       .
-        //                                      \                      .
-        //              • Planet
-        //
-        //  We have two potentials in the space, the gravitational potential
-        //  and the angular potential. These potentials are summed up, where
-        //  the angular potential is first multiplied by a factor to control
-        //  its infulence.
-        //
-        //  To get a path where the total potential remains zero, we add the
-        //  gradients for both fields, and move in a direction perpendicular
-        //  to the gradient for this total potential.
-
-        const point gravity_potential_gradient = -system.probeGravity(pos);
-        const point angular_gradient =
-            angular_potential_factor * system.probeAngularPotentialGradient(pos);
-
-        //  We need a minus sign here because I'm bad at maths..
-        const point total_gradient = gravity_potential_gradient - angular_gradient;
-
-        const point equipot_motion = point(-total_gradient.y, total_gradient.x).norm();
-        return equipot_motion * (ccw ? 1 : -1);
+        return equipotentialMotion(pos, angular_potential_factor, field, ccw);
+    };
+
+    return integrator::rungeKutta4(start_pos, gradient_func, glider_stepsize);
+}
+
+// Direction of every lane of a batch, for batches whose gliders all go the
+// same way, so the sign is known at compile time.
+template <int Sign>
+struct UniformDirection {
+    constexpr float operator[](std::size_t) const { return Sign; }
+};
+
+// The same step as above for a whole batch of gliders, direction[l] is +1
+// for the ccw lanes and -1 for the others. Step is one of the integrator
+// types, like integrator::RungeKutta4.
+template <typename Step = integrator::RungeKutta4, typename Field, typename Direction>
+PointBatch gliderStep(PointBatch const& start_pos, const float angular_potential_factor,
+                      Field const& field, Direction const& direction) {
+
+    auto gradient_func = [&](PointBatch const& pos){
+        const PointBatch total_gradient =
+            field.probeTotalGradient(pos, angular_potential_factor);
+
+        PointBatch equipot_motion;
+        for (std::size_t l = 0; l < PointBatch::lanes; ++l) {
+            equipot_motion.x[l] = -total_gradient.y[l];
+            equipot_motion.y[l] = total_gradient.x[l];
+        }
+        equipot_motion = equipot_motion.norm();
+
+        for (std::size_t l = 0; l < PointBatch::lanes; ++l) {
+            equipot_motion.x[l] *= direction[l];
+            equipot_motion.y[l] *= direction[l];
+        }
+        return equipot_motion;
+    };
+
+    return Step::step(start_pos, gradient_func, glider_stepsize);
+}
+
+// Integrates up to PointBatch::lanes gliders in lockstep. sink(lane, pos)
+// is called for the start and then for every accepted step of each glider,
+// in order, and returns whether that glider should go on. A glider that
+// stops early is masked out while the others keep going, and a lane's path
+// does not depend on what the other lanes do. Batches whose gliders all go
+// the same way take a loop with the direction fixed at compile time, see
+// groupByDirection.
+template <typename Step = integrator::RungeKutta4, typename Field, typename Sink>
+void integrateGliderBatch(const GliderStart* starts, const std::size_t n,
+                          Field const& field,
+                          const float spiral_factor,
+                          const std::size_t max_steps,
+                          Sink&& sink) {
+    profile::ScopedTimer timer ("integrate");
+
+    PointBatch pos;
+    std::array<float, PointBatch::lanes> direction;
+    std::array<bool, PointBatch::lanes> active;
+    std::size_t nr_active = 0;
+    // Only for the profile, counted once at the end
+    std::size_t nr_batch_steps = 0, nr_steps = 0;
+    std::size_t nr_too_far = 0, nr_stuck = 0, nr_by_caller = 0;
+
+    for (std::size_t l = 0; l < PointBatch::lanes; ++l) {
+        // Unused lanes just shadow the first glider
+        GliderStart const& start = starts[l < n ? l : 0];
+        pos.set(l, start.pos);
+        direction[l] = start.ccw ? 1 : -1;
+        active[l] = l < n;
+        if (active[l]) {
+            active[l] = sink(l, start.pos);
+            if (active[l]) ++nr_active;
+            else ++nr_by_caller;
+        }
+    }
+
+    auto run = [&](auto const& lane_direction) {
+        for (std::size_t step = 0; step < max_steps && nr_active > 0; ++step) {
+            const PointBatch last_pos = pos;
+            pos = gliderStep<Step>(pos, spiral_factor, field, lane_direction);
+            ++nr_batch_steps;
+
+            const auto sq_last_dist = (pos - last_pos).sqmag();
+            for (std::size_t l = 0; l < PointBatch::lanes; ++l) {
+                if (!active[l]) continue;
+
+                if (sq_last_dist[l] > sq_upper_dist_limit ||
+                    sq_last_dist[l] < sq_lower_dist_limit) {
+                    ++(sq_last_dist[l] > sq_upper_dist_limit ? nr_too_far : nr_stuck);
+                    active[l] = false;
+                    --nr_active;
+                    continue;
+                }
+
+                ++nr_steps;
+                if (!sink(l, pos[l])) {
+                    ++nr_by_caller;
+                    active[l] = false;
+                    --nr_active;
+                }
+            }
+        }
+    };
+
+    // Unused lanes have the direction of the first glider
+    const bool uniform = std::all_of(direction.begin(), direction.end(),
+                                     [&](const float d) { return d == direction[0]; });
+    if (uniform && direction[0] > 0) run(UniformDirection<1>());
+    else if (uniform) run(UniformDirection<-1>());
+    else run(direction);
+
+    // Four probes per step, of every lane whether it is in use or not
+    profile::count(profile::Counter::field_evaluations, 4 * PointBatch::lanes * nr_batch_steps);
+    profile::count(profile::Counter::steps, nr_steps);
+    profile::count(profile::Counter::stopped_too_far, nr_too_far);
+    profile::count(profile::Counter::stopped_stuck, nr_stuck);
+    profile::count(profile::Counter::stopped_by_caller, nr_by_caller);
+}
+
+// Like integrateGliderBatch, but for any number of gliders that are
+// handed out one at a time: next(lane, start) is called for every lane at
+// the beginning and again whenever the glider in that lane stops, and
+// fills in the start of the next glider, or returns false if there are no
+// more. So lanes whose gliders stop early, or are stopped by sink, are
+// refilled right away instead of idling until the whole batch is done.
+// Each glider follows the same path as it would in integrateGliderBatch.
+template <typename Step = integrator::RungeKutta4, typename Field,
+          typename Next, typename Sink>
+void integrateGliderStream(Field const& field,
+                           const float spiral_factor,
+                           const std::size_t max_steps,
+                           Next&& next,
+                           Sink&& sink) {
+    profile::ScopedTimer timer ("integrate");
+
+    PointBatch pos;
+    std::array<float, PointBatch::lanes> direction;
+    std::array<bool, PointBatch::lanes> active {};
+    std::array<std::size_t, PointBatch::lanes> lane_steps {};
+    std::size_t nr_active = 0;
+    // Only for the profile, counted once at the end
+    std::size_t nr_batch_steps = 0, nr_steps = 0;
+    std::size_t nr_too_far = 0, nr_stuck = 0, nr_by_caller = 0;
+
+    direction.fill(1.f);
+
+    // Starts gliders in lane l until one of them goes on past its start
+    auto refill = [&](const std::size_t l) {
+        GliderStart start;
+        while (next(l, start)) {
+            pos.set(l, start.pos);
+            direction[l] = start.ccw ? 1 : -1;
+            lane_steps[l] = 0;
+            const bool go_on = sink(l, start.pos);
+            if (!go_on) ++nr_by_caller;
+            if (go_on && max_steps > 0) {
+                active[l] = true;
+                ++nr_active;
+                return;
+            }
+        }
+    };
+
+    for (std::size_t l = 0; l < PointBatch::lanes; ++l) refill(l);
+
+    // Runs until a lane is refilled with a glider that goes the other way
+    // than lane_direction says, or all gliders are done
+    auto run = [&](auto const& lane_direction) {
+        while (nr_active > 0) {
+            const PointBatch last_pos = pos;
+            pos = gliderStep<Step>(pos, spiral_factor, field, lane_direction);
+            ++nr_batch_steps;
+
+            bool turned = false;
+            const auto sq_last_dist = (pos - last_pos).sqmag();
+            for (std::size_t l = 0; l < PointBatch::lanes; ++l) {
+                if (!active[l]) continue;
+
+                bool stop = false;
+                if (sq_last_dist[l] > sq_upper_dist_limit ||
+                    sq_last_dist[l] < sq_lower_dist_limit) {
+                    ++(sq_last_dist[l] > sq_upper_dist_limit ? nr_too_far : nr_stuck);
+                    stop = true;
+                } else {
+                    ++nr_steps;
+                    if (!sink(l, pos[l])) {
+                        ++nr_by_caller;
+                        stop = true;
+                    } else {
+                        stop = ++lane_steps[l] == max_steps;
+                    }
+                }
+
+                if (stop) {
+                    active[l] = false;
+                    --nr_active;
+                    refill(l);
+                    turned |= active[l] && direction[l] != lane_direction[l];
+                }
+            }
+            if (turned) return;
+        }
+    };
+
+    // Only the directions of the lanes in use matter
+    while (nr_active > 0) {
+        float first_direction = 0;
+        bool uniform = true;
+        for (std::size_t l = 0; l < PointBatch::lanes; ++l) {
+            if (!active[l]) continue;
+            if (first_direction == 0) first_direction = direction[l];
+            uniform &= direction[l] == first_direction;
+        }
+        if (uniform && first_direction > 0) run(UniformDirection<1>());
+        else if (uniform) run(UniformDirection<-1>());
+        else run(direction);
+    }
+
+    profile::count(profile::Counter::field_evaluations, 4 * PointBatch::lanes * nr_batch_steps);
+    profile::count(profile::Counter::steps, nr_steps);
+    profile::count(profile::Counter::stopped_too_far, nr_too_far);
+    profile::count(profile::Counter::stopped_stuck, nr_stuck);
+    profile::count(profile::Counter::stopped_by_caller, nr_by_caller);
+}
+
+// The ccw starts first and then the others, each in their original order,
+// so that all but at most one batch go a single way. order[i] is the index
+// in starts of grouped[i].
+inline void groupByDirection(std::vector<GliderStart> const& starts,
+                             std::vector<GliderStart>& grouped,
+                             std::vector<std::size_t>& order) {
+    order.clear();
+    for (std::size_t i = 0; i < starts.size(); ++i) {
+        if (starts[i].ccw) order.push_back(i);
+    }
+    for (std::size_t i = 0; i < starts.size(); ++i) {
+        if (!starts[i].ccw) order.push_back(i);
+    }
+    grouped.resize(starts.size());
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        grouped[i] = starts[order[i]];
+    }
+}
+
+// Trajectories for all the given starts, integrated in batches that are
+// spread over nr_threads threads (0 for all cores). They are written into
+// pool, which only allocates when it has to grow.
+template <typename Step = integrator::RungeKutta4, typename Field>
+void generateGliderTrajectories(std::vector<GliderStart> const& starts,
+                                Field const& field,
+                                const float spiral_factor,
+                                const std::size_t max_steps,
+                                TrajectoryPool& pool,
+                                const unsigned nr_threads = 0) {
+    pool.reset(starts.size(), max_steps + 1);
+    const std::size_t nr_batches = (starts.size() + PointBatch::lanes - 1) / PointBatch::lanes;
+
+    std::vector<GliderStart> grouped;
+    std::vector<std::size_t> order;
+    groupByDirection(starts, grouped, order);
+
+    parallel::forEach(nr_batches, [&](unsigned, const std::size_t batch) {
+        const std::size_t first = batch * PointBatch::lanes;
+        const std::size_t n = std::min(std::size_t(PointBatch::lanes), starts.size() - first);
+
+        integrateGliderBatch<Step>(&grouped[first], n, field, spiral_factor, max_steps,
+                                   [&](const std::size_t lane, point const& p) {
+                                       pool.push(order[first + lane], p);
+                                       return true;
+                                   });
+    }, nr_threads);
+}
+
+template <typename Step = integrator::RungeKutta4, typename Field>
+std::vector<std::vector<point>> generateGliderTrajectories(std::vector<GliderStart> const& starts,
+                                                           Field const& field,
+                                                           const float spiral_factor,
+                                                           const std::size_t max_steps,
+                                                           const unsigned nr_threads = 0) {
+    TrajectoryPool pool;
+    generateGliderTrajectories<Step>(starts, field, spiral_factor, max_steps, pool, nr_threads);
+
+    std::vector<std::vector<point>> trajectories(starts.size());
+    for (std::size_t i = 0; i < starts.size(); ++i) {
+        trajectories[i].assign(pool[i].begin(), pool[i].end());
+    }
+
+    return trajectories;
+}
+
+// Writes the trajectory into points, replacing what was there before. The
+// buffer keeps its capacity, so reusing it for the next trajectory does
+// not allocate. A single glider would only fill one lane of a batch, so it
+// is stepped on its own, through the field's probeLaneTotalGradient and
+// with the stopping rules of integrateGliderBatch. That is the path the
+// glider takes in a batch, so a nice path comes out as it was scored.
+template <typename Field>
+void generateGliderTrajectory(point pos,
+                              Field const& field,
+                              const float spiral_factor,
+                              const std::size_t max_steps,
+                              const bool ccw,
+                              std::vector<point>& points) {
+    profile::ScopedTimer timer ("integrate");
+
+    const float direction = ccw ? 1 : -1;
+    auto gradient_func = [&](point const& p) {
+        const point total_gradient = field.probeLaneTotalGradient(p, spiral_factor);
+        return point(-total_gradient.y, total_gradient.x).norm() * direction;
     };
 
-    const float stepsize = 10.f;
-    return integrator::rungeKutta4(start_pos, gradient_func, stepsize);
+    points.clear();
+    points.reserve(max_steps + 1);
+    points.push_back(pos);
+
+    for (std::size_t step = 0; step < max_steps; ++step) {
+        const point last_pos = pos;
+        pos = integrator::rungeKutta4(pos, gradient_func, glider_stepsize);
+
+        const float sq_last_dist = (pos - last_pos).sqmag();
+        if (sq_last_dist > sq_upper_dist_limit || sq_last_dist < sq_lower_dist_limit) {
+            profile::count(sq_last_dist > sq_upper_dist_limit
+                           ? profile::Counter::stopped_too_far
+                           : profile::Counter::stopped_stuck);
+            break;
+        }
+        points.push_back(pos);
+    }
+
+    profile::count(profile::Counter::field_evaluations, 4 * (points.size() - 1));
+    profile::count(profile::Counter::steps, points.size() - 1);
 }
 
+template <typename Field>
 std::vector<point> generateGliderTrajectory(point pos,
-                                            System const& system,
+                                            Field const& field,
+                                            const float spiral_factor,
+                                            const std::size_t max_steps,
+                                            const bool ccw) {
+    std::vector<point> points;
+    generateGliderTrajectory(pos, field, spiral_factor, max_steps, ccw, points);
+    return points;
+}
+
+template <typename Field>
+std::vector<point> generateGliderTrajectory(point pos,
+                                            Field const& field,
                                             const float spiral_factor,
                                             const std::size_t max_steps) {
-    const float sq_lower_dist_limit = 0.005f;
-    const float sq_upper_dist_limit = 400.f;
+    return generateGliderTrajectory(pos, field, spiral_factor, max_steps, rand()&1);
+}
+
+// Like generateGliderTrajectory, but with an adaptive Dormand-Prince
+// integrator that takes long steps where the field is calm and short ones
+// near planets, keeping the local error of every step below tolerance.
+// Integrates until the glider has travelled arc_length, or got stuck in a
+// spot where even the smallest step can't meet the tolerance.
+template <typename Field>
+std::vector<point> generateAdaptiveGliderTrajectory(point pos,
+                                                    Field const& field,
+                                                    const float spiral_factor,
+                                                    const float arc_length,
+                                                    const float tolerance,
+                                                    const bool ccw) {
+    profile::ScopedTimer timer ("integrate adaptive");
+
+    const float min_stepsize = 0.05f;
+    const float max_stepsize = 8 * glider_stepsize;
+    // The fixed step limit on the squared step length, relative to the
+    // squared step size.
+    const float sq_lower_dist_ratio = 0.005f / (glider_stepsize * glider_stepsize);
+    const std::size_t max_points = arc_length / min_stepsize + 1;
+
+    auto gradient_func = [&](point const& p){
+        return equipotentialMotion(p, spiral_factor, field, ccw);
+    };
+    auto norm = [](point const& p) { return p.mag(); };
 
     std::vector<point> points {pos};
-    const bool ccw = rand()&1;
+    float stepsize = glider_stepsize;
+    float travelled = 0.f;
+
+    while (arc_length - travelled >= min_stepsize && points.size() < max_points) {
+        stepsize = std::min(stepsize, arc_length - travelled);
 
-    for (std::size_t step = 0; step < max_steps; ++step) {
         const point last_pos = pos;
-        pos = gliderStep(pos, spiral_factor, system, ccw);
+        float taken, error;
+        pos = integrator::adaptiveDormandPrince(pos, gradient_func, stepsize, taken, error,
+                                                tolerance, norm, min_stepsize, max_stepsize);
 
         const float sq_last_dist = (pos - last_pos).sqmag();
-        if (sq_last_dist > sq_upper_dist_limit ||
-            sq_last_dist < sq_lower_dist_limit) {
+        if (error > tolerance || !(sq_last_dist >= sq_lower_dist_ratio * taken * taken)) {
+            profile::count(profile::Counter::stopped_stuck);
             break;
         }
 
         points.push_back(pos);
+        // Unit speed, so the integration time is the arc length
+        travelled += taken;
     }
 
+    profile::count(profile::Counter::steps, points.size() - 1);
     return points;
 }
 
-float scorePath(System const& system, std::array<point, 2> const& bounds,
-                std::vector<point> const& path) {
+template <typename Field>
+std::vector<std::vector<point>> generateAdaptiveGliderTrajectories(std::vector<GliderStart> const& starts,
+                                                                   Field const& field,
+                                                                   const float spiral_factor,
+                                                                   const float arc_length,
+                                                                   const float tolerance,
+                                                                   const unsigned nr_threads = 0) {
+    std::vector<std::vector<point>> trajectories(starts.size());
+
+    parallel::forEach(starts.size(), [&](unsigned, const std::size_t i) {
+        trajectories[i] = generateAdaptiveGliderTrajectory(starts[i].pos, field, spiral_factor,
+                                                           arc_length, tolerance, starts[i].ccw);
+    }, nr_threads, 8);
+
+    return trajectories;
+}
+
+// The running state of scorePath, updated one point at a time, so that a
+// path can be scored while it is integrated.
+class PathScorer {
+    NearestPlanetIndex const* planets;
+    std::array<point, 2> bounds;
+
+    point last;
+    std::size_t nr_points = 0;
     float path_length = 0.f;
     unsigned planet_switches = 0;
     float penalty = 0.f;
     std::size_t current_closest_planet = 0;
-    /*std::vector<point> centres;
-      const float curve_check_interval = 50.f;
-      const float last_curve_check = 0.f;
-      std::size_t last_curve_check_index = 0;*/
-    for (std::size_t i = 1; i < path.size(); ++i) {
+
+public:
+    PathScorer(NearestPlanetIndex const& planets, std::array<point, 2> const& bounds)
+        : planets(&planets), bounds(bounds) {}
+
+    void add(point const& p) {
+        if (nr_points++ == 0) {
+            last = p;
+            return;
+        }
+        const point prev = last;
+        last = p;
+
         // Only count points inside bounds
-        if (path[i].x < bounds[0].x || path[i].y < bounds[0].y ||
-            path[i].x > bounds[1].x || path[i].y > bounds[1].y) {
+        if (p.x < bounds[0].x || p.y < bounds[0].y ||
+            p.x > bounds[1].x || p.y > bounds[1].y) {
             penalty += 3;
-            continue;
+            return;
         }
 
-        path_length += (path[i] - path[i-1]).mag();
+        path_length += (p - prev).mag();
 
-        float sq_lowest_dist = std::numeric_limits<float>::max();
-        std::size_t new_closest_planet = 0;
-        for (std::size_t planet_id = 0; planet_id < system.planets.size(); ++planet_id) {
-            const point r = system.planets[planet_id].pos - path[i];
-            if (r.sqmag() < sq_lowest_dist) {
-                sq_lowest_dist = r.sqmag();
-                new_closest_planet = planet_id;
-            }
-        }
+        const std::size_t new_closest_planet = planets->closest(p);
 
         if (new_closest_planet != current_closest_planet) {
-            const point r_current = system.planets[current_closest_planet].pos - path[i];
-            const point r_new = system.planets[new_closest_planet].pos - path[i];
+            const point r_current = planets->position(current_closest_planet) - p;
+            const point r_new = planets->position(new_closest_planet) - p;
                 
             // prevent frequent switches near a border
             if (r_new.sqmag() * 1.2f < r_current.sqmag()) {
@@ -111,81 +536,276 @@ float scorePath(System const& system, std::array<point, 2> const& bounds,
             }
         }
 
-        const point r = system.planets[current_closest_planet].pos - path[i];
+        const point r = planets->position(current_closest_planet) - p;
         if (r.sqmag() < 100.f) penalty += 500;
+    }
 
-        /*
-          if (path_length - last_curve_check > curve_check_interval &&
-          last_curve_check_index < i - 2) {
-                
-          const point
-          a = path[last_curve_check_index],
-          b = path[(last_curve_check_index + i) / 2],
-          c = path[i];
-
-          // Find the centre of the circle described by the three
-          // points a, b, c. Algorithm from
-          // https://math.stackexchange.com/a/1460096
-            
-          Eigen::Matrix<float, 3, 4> data;
-          data <<
-              a.sqmag(), a.x, a.y, 1,
-              b.sqmag(), b.x, b.y, 1,
-              c.sqmag(), c.x, c.y, 1;
-
-          Eigen::Matrix3f m = data.block(0, 1, 3, 3);
-          const float m11 = m.determinant();
-          if (fabs(m11) < 0.001) {
-              // points are roughly colinear
-              continue;
-          }
-            
-          m.col(0) = data.col(0);
-          const float m12 = m.determinant();
-          m.col(1) = data.col(1);
-          const float m13 = m.determinant();
-
-          point center (m12/m11, m13/m11);
-          center /= 2;
-
-          //last_curve_check = path_length;
-          last_curve_check_index = i;
-          }
-        */
-    }
-
-    const float score = 0 * path_length + planet_switches * 100.f - penalty;
-
-    return score;
-}
-
-point findNicePath(System const& system,
-                   const float spiral_factor, const std::size_t max_steps,
-                   std::array<point,2> const& bounds, const int seed) {
+    std::size_t size() const { return nr_points; }
+
+    float score() const {
+        return 0 * path_length + planet_switches * 100.f - penalty;
+    }
+
+    // Upper bound for the score after up to remaining_points more points.
+    // The penalty never goes down and every point adds at most one planet
+    // switch, except for the points outside of bounds, which only add to
+    // the penalty. A glider moves at most glider_stepsize per point, so
+    // once it is outside that many of the next points are too.
+    float bestPossible(const std::size_t remaining_points) const {
+        const float dx = std::max({bounds[0].x - last.x, last.x - bounds[1].x, 0.f});
+        const float dy = std::max({bounds[0].y - last.y, last.y - bounds[1].y, 0.f});
+        // With a little room for rounding in the steps
+        const float steps_outside = std::sqrt(dx * dx + dy * dy) / (1.001f * glider_stepsize);
+        const std::size_t nr_outside = steps_outside > 1
+            ? std::min(remaining_points, static_cast<std::size_t>(std::ceil(steps_outside)) - 1)
+            : 0;
+        return score() + 100.f * (remaining_points - nr_outside) - 3.f * nr_outside;
+    }
+};
+
+inline float scorePath(NearestPlanetIndex const& planets, std::array<point, 2> const& bounds,
+                       PointSpan path) {
+    profile::ScopedTimer timer ("score path");
+    profile::count(profile::Counter::scored_points, path.size());
+
+    PathScorer scorer (planets, bounds);
+    for (auto const& p : path) {
+        scorer.add(p);
+    }
+
+    return scorer.score();
+}
+
+inline float scorePath(System const& system, std::array<point, 2> const& bounds,
+                       PointSpan path) {
+    return scorePath(NearestPlanetIndex(system, bounds), bounds, path);
+}
+
+// Goes up with every change to scorePath, the candidates or the searches
+// that changes which nice path they find, so that nice paths cached from
+// before are not used any more, see nice_path_cache.hpp
+const std::uint32_t nice_path_version = 2;
+
+struct NicePath {
+    point start;
+    bool ccw;
+    float score;
+};
+
+// Every candidate gets its own rng stream derived from the seed and its
+// index, so the result does not depend on how the candidates are spread
+// over threads. Ties go to the highest index, like in a sequential scan.
+template <typename RNG = std::mt19937>
+RNG candidateRng(const int seed, const std::size_t index) {
     // Offset seed to avoid collision with generated planets
-    std::mt19937 rng(seed + 2000);
+    std::seed_seq seq {seed + 2000, static_cast<int>(index)};
+    return RNG(seq);
+}
+
+// Index of the highest score, the highest index on ties
+inline std::size_t bestCandidate(std::vector<float> const& scores) {
+    std::size_t best = 0;
+    for (std::size_t i = 1; i < scores.size(); ++i) {
+        if (scores[i] >= scores[best]) best = i;
+    }
+    return best;
+}
+
+// Scores candidate starts for the nice path search. Paths are integrated
+// through field in batches spread over the threads, and scored against the
+// planets of system while they are integrated. Keeps count of the
+// integration steps, which is what a search spends its budget on.
+//
+// Once the flag cancelled points to is set, the candidates that are not
+// scored yet get lowest(), so a search that is no longer wanted runs out
+// right away. Its result is meaningless then.
+template <typename Field>
+class CandidateEvaluator {
+    Field const& field;
+    NearestPlanetIndex planets;
+    std::array<point, 2> bounds;
+    float spiral_factor;
+    unsigned nr_threads;
+    std::atomic<bool> const* cancelled;
+    std::atomic<std::size_t> steps {0};
+
+    // One batch worth of scorers per thread, reused for all its batches
+    std::vector<std::vector<PathScorer>> scorers;
+
+    // score with prune. Pruned lanes would idle until their whole batch is
+    // done, so every thread streams the candidates through one batch
+    // instead, taking the next one whenever a lane is free. The direction
+    // groups keep all but a few of the steps going one way.
+    void scorePruned(std::vector<GliderStart> const& grouped,
+                     std::vector<std::size_t> const& order,
+                     const std::size_t max_steps, std::vector<float>& scores) {
+        std::atomic<float> best_score {std::numeric_limits<float>::lowest()};
+        std::atomic<std::size_t> next_start {0};
+
+        const unsigned nr_streams =
+            parallel::threadCountFor(grouped.size(), nr_threads, PointBatch::lanes);
+        scorers.resize(nr_streams);
+
+        parallel::forEach(nr_streams, [&](const unsigned thread_id, std::size_t) {
+            std::vector<PathScorer>& lane_scorers = scorers[thread_id];
+            lane_scorers.assign(PointBatch::lanes, PathScorer(planets, bounds));
+            std::array<std::size_t, PointBatch::lanes> candidate;
+            candidate.fill(grouped.size());
+            std::array<bool, PointBatch::lanes> pruned {};
+            std::size_t stream_steps = 0;
+
+            auto finish = [&](const std::size_t lane) {
+                PathScorer const& scorer = lane_scorers[lane];
+                stream_steps += scorer.size() - 1;
+                profile::count(profile::Counter::scored_points, scorer.size());
+                if (pruned[lane]) return;
+
+                const float score = scorer.score();
+                scores[order[candidate[lane]]] = score;
+
+                float current = best_score.load(std::memory_order_relaxed);
+                while (score > current &&
+                       !best_score.compare_exchange_weak(current, score,
+                                                         std::memory_order_relaxed)) {}
+            };
+
+            integrateGliderStream(field, spiral_factor, max_steps,
+                                  [&](const std::size_t lane, GliderStart& start) {
+                                      if (candidate[lane] < grouped.size()) finish(lane);
+                                      if (isCancelled()) return false;
+                                      candidate[lane] = next_start++;
+                                      if (candidate[lane] >= grouped.size()) return false;
+                                      start = grouped[candidate[lane]];
+                                      lane_scorers[lane] = PathScorer(planets, bounds);
+                                      pruned[lane] = false;
+                                      return true;
+                                  },
+                                  [&](const std::size_t lane, point const& p) {
+                                      PathScorer& scorer = lane_scorers[lane];
+                                      scorer.add(p);
+                                      const std::size_t remaining = max_steps + 1 - scorer.size();
+                                      pruned[lane] = scorer.bestPossible(remaining) <
+                                          best_score.load(std::memory_order_relaxed);
+                                      return !pruned[lane];
+                                  });
+            steps += stream_steps;
+        }, nr_streams);
+    }
 
-    float candidate_score = std::numeric_limits<float>::min();
-    point candidate;
+public:
+    CandidateEvaluator(System const& system, Field const& field,
+                       std::array<point, 2> const& bounds, const float spiral_factor,
+                       const unsigned nr_threads = 0,
+                       std::atomic<bool> const* cancelled = nullptr)
+        : field(field), planets(system, bounds), bounds(bounds),
+          spiral_factor(spiral_factor), nr_threads(nr_threads), cancelled(cancelled) {}
+
+    NearestPlanetIndex const& planetIndex() const { return planets; }
+    std::array<point, 2> const& searchBounds() const { return bounds; }
+    float spiralFactor() const { return spiral_factor; }
+    unsigned threads() const { return nr_threads; }
+
+    std::size_t stepsTaken() const { return steps; }
+
+    bool isCancelled() const { return cancelled && *cancelled; }
+
+    // Scores of the starts after up to max_steps steps. With prune, a
+    // candidate is dropped as soon as even its best possible score is below
+    // the best score found so far by any thread, and gets lowest() instead.
+    // It could not have been the best one, as ties need an equal score, so
+    // the best candidate is the same as without pruning.
+    std::vector<float> score(std::vector<GliderStart> const& starts,
+                             const std::size_t max_steps, const bool prune = false) {
+        profile::ScopedTimer timer ("score candidates");
+
+        std::vector<float> scores(starts.size(), std::numeric_limits<float>::lowest());
+
+        std::vector<GliderStart> grouped;
+        std::vector<std::size_t> order;
+        groupByDirection(starts, grouped, order);
+
+        if (prune) {
+            scorePruned(grouped, order, max_steps, scores);
+            return scores;
+        }
 
-    const int max_attempts = 1000;
+        const std::size_t nr_batches = (starts.size() + PointBatch::lanes - 1) / PointBatch::lanes;
+        scorers.resize(parallel::threadCountFor(nr_batches, nr_threads));
 
-    for (int i = 0; i < max_attempts; ++i) {
-        const point p = point::randomPoint(bounds, rng);
+        parallel::forEach(nr_batches, [&](const unsigned thread_id, const std::size_t batch) {
+            if (isCancelled()) return;
+            const std::size_t first = batch * PointBatch::lanes;
+            const std::size_t n = std::min(std::size_t(PointBatch::lanes), starts.size() - first);
 
-        const auto trajectory = generateGliderTrajectory(p, system, spiral_factor, max_steps);
+            std::vector<PathScorer>& lane_scorers = scorers[thread_id];
+            lane_scorers.assign(n, PathScorer(planets, bounds));
+
+            integrateGliderBatch(&grouped[first], n, field, spiral_factor, max_steps,
+                                 [&](const std::size_t lane, point const& p) {
+                                     lane_scorers[lane].add(p);
+                                     return true;
+                                 });
+
+            std::size_t batch_steps = 0;
+            for (std::size_t l = 0; l < n; ++l) {
+                batch_steps += lane_scorers[l].size() - 1;
+                profile::count(profile::Counter::scored_points, lane_scorers[l].size());
+                scores[order[first + l]] = lane_scorers[l].score();
+            }
+            steps += batch_steps;
+        }, nr_threads);
 
-        const float score = scorePath(system, bounds, trajectory);
-        
-        if (score >= candidate_score) {
-            candidate_score = score;
-            candidate = p;
+        return scores;
+    }
+
+    // The full trajectories, for searches that want to look at the paths
+    void trajectories(std::vector<GliderStart> const& starts, const std::size_t max_steps,
+                      TrajectoryPool& pool) {
+        generateGliderTrajectories(starts, field, spiral_factor, max_steps, pool, nr_threads);
+        for (std::size_t i = 0; i < pool.size(); ++i) {
+            steps += pool[i].size() - 1;
         }
     }
+};
+
+// Uniformly random candidates in bounds, the ith one from candidateRng(seed, i)
+inline std::vector<GliderStart> randomCandidates(const std::size_t n, const int seed,
+                                                 std::array<point,2> const& bounds,
+                                                 const std::size_t first_index = 0) {
+    std::vector<GliderStart> starts(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        auto rng = candidateRng(seed, first_index + i);
+        starts[i].pos = point::randomPoint(bounds, rng);
+        starts[i].ccw = rng() & 1;
+    }
+    return starts;
+}
+
+// Tries attempts random starts and keeps the best one. See search.hpp for
+// searches that get by with fewer integration steps. Gives up early once
+// cancelled is set, see CandidateEvaluator.
+template <typename Field>
+NicePath findNicePath(System const& system, Field const& field,
+                      const float spiral_factor, const std::size_t max_steps,
+                      std::array<point,2> const& bounds, const int seed,
+                      const unsigned nr_threads = 0, const std::size_t attempts = 1000,
+                      std::atomic<bool> const* cancelled = nullptr) {
+    profile::ScopedTimer timer ("find nice path");
+
+    CandidateEvaluator<Field> evaluator (system, field, bounds, spiral_factor, nr_threads,
+                                         cancelled);
+    const auto starts = randomCandidates(std::max<std::size_t>(1, attempts), seed, bounds);
+    const auto scores = evaluator.score(starts, max_steps, true);
+
+    const std::size_t best = bestCandidate(scores);
+    return {starts[best].pos, starts[best].ccw, scores[best]};
+}
 
-    std::cout << "found path with score " << candidate_score << '\n';
-    
-    return candidate;
+inline NicePath findNicePath(System const& system,
+                             const float spiral_factor, const std::size_t max_steps,
+                             std::array<point,2> const& bounds, const int seed,
+                             const unsigned nr_threads = 0) {
+    return findNicePath(system, system, spiral_factor, max_steps, bounds, seed, nr_threads);
 }
 
 #endif // GLIDER_HPP
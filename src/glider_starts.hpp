@@ -0,0 +1,100 @@
+#ifndef GLIDER_STARTS_HPP
+#define GLIDER_STARTS_HPP
+
+#include <array>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "point.hpp"
+
+// Where the gliders of a picture start, apart from the integration so
+// that the parameters can name the sampling without all of glider.hpp.
+
+struct GliderStart {
+    point pos;
+    bool ccw;
+};
+
+// Starts for the gliders that make up the picture of a seed. They get
+// their own rng stream, offset from the seed because otherwise, we might
+// get the same points as we did for the planets, which would not be very
+// helpful.
+inline std::vector<GliderStart> randomGliderStarts(const std::size_t nr_gliders, const int seed,
+                                                   std::array<point, 2> const& bounds) {
+    std::mt19937 rng (seed + 1000);
+
+    std::vector<GliderStart> starts(nr_gliders);
+    for (auto& start : starts) {
+        start.pos = point::randomPoint(bounds, rng);
+        start.ccw = rng() & 1;
+    }
+
+    return starts;
+}
+
+// Radical inverse of i in base, the ith number of the van der Corput
+// sequence.
+inline float radicalInverse(std::size_t i, const unsigned base) {
+    const float inv_base = 1.f / base;
+    float digit_value = inv_base;
+    float out = 0.f;
+    while (i > 0) {
+        out += digit_value * (i % base);
+        i /= base;
+        digit_value *= inv_base;
+    }
+    return out;
+}
+
+// Like randomGliderStarts, but the positions are the Halton sequence in
+// bases 2 and 3, which covers bounds more evenly than uniform random points
+// do, so the picture converges with fewer gliders. The sequence is shifted
+// by a random offset (modulo 1) from the seed's stream, so every seed still
+// gets its own points. Any prefix of the starts is again evenly spread.
+inline std::vector<GliderStart> haltonGliderStarts(const std::size_t nr_gliders, const int seed,
+                                                   std::array<point, 2> const& bounds) {
+    std::mt19937 rng (seed + 1000);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+    const float shift_x = unit(rng);
+    const float shift_y = unit(rng);
+
+    const point size = bounds[1] - bounds[0];
+    std::vector<GliderStart> starts(nr_gliders);
+    for (std::size_t i = 0; i < nr_gliders; ++i) {
+        float u = radicalInverse(i + 1, 2) + shift_x;
+        float v = radicalInverse(i + 1, 3) + shift_y;
+        u -= std::floor(u);
+        v -= std::floor(v);
+        starts[i].pos = bounds[0] + point(u * size.x, v * size.y);
+        starts[i].ccw = rng() & 1;
+    }
+
+    return starts;
+}
+
+enum class GliderSampling { random, halton };
+
+inline std::istream& operator>>(std::istream& in, GliderSampling& sampling) {
+    std::string name;
+    in >> name;
+    if (name == "random") sampling = GliderSampling::random;
+    else if (name == "halton") sampling = GliderSampling::halton;
+    else in.setstate(std::ios::failbit);
+    return in;
+}
+
+inline std::ostream& operator<<(std::ostream& out, const GliderSampling sampling) {
+    return out << (sampling == GliderSampling::halton ? "halton" : "random");
+}
+
+inline std::vector<GliderStart> gliderStarts(const std::size_t nr_gliders, const int seed,
+                                             std::array<point, 2> const& bounds,
+                                             const GliderSampling sampling) {
+    return sampling == GliderSampling::halton
+        ? haltonGliderStarts(nr_gliders, seed, bounds)
+        : randomGliderStarts(nr_gliders, seed, bounds);
+}
+
+#endif // GLIDER_STARTS_HPP
@@ -0,0 +1,48 @@
+#ifndef GLIDERS_CORE_HPP
+#define GLIDERS_CORE_HPP
+
+// Everything that computes the pictures, without the viewer. Needs Eigen
+// and threads, but neither SFML nor Boost, and can be included from any
+// number of translation units. This is what the gliders_core CMake target
+// makes available.
+//
+// The main entry points:
+//
+//  - System holds the planets and probes their fields exactly. FieldGrid
+//    and BarnesHut approximate the same fields faster, and can be used in
+//    place of a System wherever a Field template parameter is taken.
+//    withBackend picks one of them at run time.
+//  - gliderStarts picks the start positions for the gliders of a seed.
+//  - generateGliderTrajectories integrates all of them into a
+//    TrajectoryPool, generateGliderTrajectory integrates a single one.
+//  - scorePath rates a path by how often it switches between planets,
+//    findNicePath searches for the best rated one, and NicePathCache keeps
+//    the results in a file.
+//  - writeTrajectoryFile keeps trajectories in a compact file, which
+//    TrajectoryFile maps back in to draw them again. SvgWriter and
+//    PolylineSimplifier write them as vector graphics, renderTiled
+//    draws them into pictures of any size, and DensityBuffer counts them
+//    per pixel for toneMap.
+//  - sweepPlanets and NicePathTracker animate a seed, see sweep.hpp.
+//
+// profile.hpp has the timers and counters, which are only recorded in
+// builds with GLIDERS_PROFILE.
+
+#include "barnes_hut.hpp"
+#include "density.hpp"
+#include "field_backend.hpp"
+#include "field_grid.hpp"
+#include "glider.hpp"
+#include "nearest_planet.hpp"
+#include "nice_path_cache.hpp"
+#include "point.hpp"
+#include "profile.hpp"
+#include "search.hpp"
+#include "svg.hpp"
+#include "sweep.hpp"
+#include "system.hpp"
+#include "tiled_render.hpp"
+#include "trajectory_file.hpp"
+#include "trajectory_pool.hpp"
+
+#endif // GLIDERS_CORE_HPP
@@ -0,0 +1,591 @@
+#ifndef HEADLESS_HPP
+#define HEADLESS_HPP
+
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <boost/filesystem.hpp>
+#include <SFML/Graphics.hpp>
+
+#include "barnes_hut.hpp"
+#include "density.hpp"
+#include "exact_field.hpp"
+#include "glider.hpp"
+#include "image_writer.hpp"
+#include "nice_path_cache.hpp"
+#include "params.hpp"
+#include "parallel.hpp"
+#include "profile.hpp"
+#include "raster.hpp"
+#include "search.hpp"
+#include "svg.hpp"
+#include "sweep.hpp"
+#include "system.hpp"
+#include "tiled_render.hpp"
+#include "trajectory_file.hpp"
+
+// Renders seeds straight to png files with the software rasterizer, so no
+// window or OpenGL context is needed. The pictures are the same as the
+// trajectory view of the viewer. The trajectories can also be kept in
+// .traj files and drawn again from there, see trajectory_file.hpp, and a
+// seed can be animated with runSweep.
+
+inline std::array<point, 2> imageBounds(Params const& params) {
+    return {point(0.f, 0.f), point((float)params.width, (float)params.height)};
+}
+
+// Everything that is drawn for a seed
+struct SeedTrajectories {
+    TrajectoryPool gliders;
+    // Empty unless params.nice_path_seed is set
+    std::vector<point> nice_path;
+
+    // The gliders and then the nice path, if there is one
+    std::size_t size() const { return gliders.size() + (nice_path.empty() ? 0 : 1); }
+    PointSpan operator[](const std::size_t i) const {
+        return i < gliders.size() ? gliders[i] : PointSpan(nice_path);
+    }
+};
+
+// Writes line to std::cout in one piece, for the messages of jobs that run
+// in parallel, whose lines would run into each other otherwise
+inline void printLine(std::string const& line) {
+    static std::mutex mutex;
+    std::lock_guard<std::mutex> lock(mutex);
+    std::cout << line << '\n';
+}
+
+// The cache of params.nice_path_cache, opened on first use and shared by
+// all threads. Without a file it finds every nice path again.
+inline NicePathCache& nicePathCache(Params const& params) {
+    static NicePathCache cache;
+    static std::once_flag opened;
+    std::call_once(opened, [&]() {
+        if (params.nice_path_cache.empty()) return;
+        // Its directory is made the first time, like the screenshot one
+        namespace fs = boost::filesystem;
+        const fs::path dir = fs::path(params.nice_path_cache).parent_path();
+        boost::system::error_code error;
+        if (!dir.empty()) fs::create_directories(dir, error);
+        if (!cache.open(params.nice_path_cache)) {
+            std::cerr << "could not open " << params.nice_path_cache
+                      << ", nice paths are not cached\n";
+        }
+    });
+    return cache;
+}
+
+// The nice path of the system of seed for params.nice_path_seed, empty if
+// that is 0
+inline std::vector<point> nicePathPoints(Params const& params, System const& system,
+                                         const int seed, const unsigned nr_threads) {
+    if (params.nice_path_seed == 0) return {};
+    const auto key = nicePathKey(seed, params.nice_path_seed, params.nr_planets,
+                                 params.max_steps, params.spiral_factor, imageBounds(params),
+                                 params.search, params.nice_path_attempts);
+    const NicePath nice_path = nicePathCache(params).get(key, [&]() {
+        return findNicePath(system, system, params.spiral_factor, params.max_steps,
+                            imageBounds(params), params.nice_path_seed, params.search,
+                            nr_threads, params.nice_path_attempts);
+    });
+    std::ostringstream line;
+    line << "found path with score " << nice_path.score;
+    printLine(line.str());
+    return generateGliderTrajectory(nice_path.start, system, params.spiral_factor,
+                                    params.max_steps, nice_path.ccw);
+}
+
+// Integrates the gliders of the seed a chunk at a time and calls
+// func(trajectories) for each chunk, so only a chunk of trajectories is
+// ever in memory
+template <typename Func>
+void forEachGliderChunk(Params const& params, System const& system, const int seed,
+                        const unsigned nr_threads, Func&& func) {
+    const auto starts = gliderStarts(params.nr_gliders, seed, imageBounds(params),
+                                     params.sampling);
+    const std::size_t chunk_size = 1024;
+    std::vector<GliderStart> chunk;
+    TrajectoryPool trajectories;
+    withBackend(params.backend, params.backend_options, system, imageBounds(params),
+                params.spiral_factor, [&](auto const& field) {
+        integrator::withMethod(params.step_method, [&](auto step) {
+            for (std::size_t first = 0; first < starts.size(); first += chunk_size) {
+                const std::size_t last = std::min(starts.size(), first + chunk_size);
+                chunk.assign(starts.begin() + first, starts.begin() + last);
+                generateGliderTrajectories<decltype(step)>(chunk, field, params.spiral_factor,
+                                                           params.max_steps, trajectories,
+                                                           nr_threads);
+                func(static_cast<TrajectoryPool const&>(trajectories));
+            }
+        });
+    });
+}
+
+// The gliders of the seed, through the field of params.backend, which is
+// specialized for the system and the integrator
+inline void integrateGliders(Params const& params, System const& system, const int seed,
+                             TrajectoryPool& out, const unsigned nr_threads = 1) {
+    const auto bounds = imageBounds(params);
+    const auto starts = gliderStarts(params.nr_gliders, seed, bounds, params.sampling);
+    withBackend(params.backend, params.backend_options, system, bounds, params.spiral_factor,
+                [&](auto const& field) {
+        integrator::withMethod(params.step_method, [&](auto step) {
+            generateGliderTrajectories<decltype(step)>(starts, field, params.spiral_factor,
+                                                       params.max_steps, out, nr_threads);
+        });
+    });
+}
+
+inline SeedTrajectories integrateSeed(Params const& params, const int seed,
+                                      const unsigned nr_threads = 1) {
+    const auto bounds = imageBounds(params);
+
+    std::mt19937 rng(seed);
+    const System system(params.nr_planets, bounds, rng);
+
+    SeedTrajectories out;
+    integrateGliders(params, system, seed, out.gliders, nr_threads);
+    out.nice_path = nicePathPoints(params, system, seed, nr_threads);
+    return out;
+}
+
+inline bool saveTrajectories(Params const& params, const int seed,
+                             SeedTrajectories const& trajectories, std::string const& path) {
+    TrajectoryFileHeader info {};
+    info.seed = seed;
+    info.nr_planets = static_cast<std::uint32_t>(params.nr_planets);
+    info.spiral_factor = params.spiral_factor;
+    info.max_steps = static_cast<std::uint32_t>(params.max_steps);
+    info.step_method = static_cast<std::uint32_t>(params.step_method);
+    info.nice_path_seed = params.nice_path_seed;
+    const auto bounds = imageBounds(params);
+    info.bounds[0] = bounds[0].x;
+    info.bounds[1] = bounds[0].y;
+    info.bounds[2] = bounds[1].x;
+    info.bounds[3] = bounds[1].y;
+    return writeTrajectoryFile(path, info, trajectories.gliders, trajectories.nice_path);
+}
+
+inline Rgba backgroundColour() { return Rgba::fromBytes(30, 30, 30); }
+inline Rgba gliderColour() { return Rgba::fromBytes(255, 255, 255, 20); }
+inline Rgba nicePathColour() { return Rgba::fromBytes(255, 0, 0); }
+
+inline Canvas drawSeed(Params const& params, SeedTrajectories const& trajectories) {
+    Canvas canvas(params.width, params.height, backgroundColour());
+
+    {
+        profile::ScopedTimer draw_timer ("draw trajectories");
+        for (std::size_t i = 0; i < trajectories.gliders.size(); ++i) {
+            canvas.drawPolyline(trajectories.gliders[i], gliderColour());
+        }
+    }
+
+    if (!trajectories.nice_path.empty()) {
+        profile::ScopedTimer draw_timer ("draw nice path");
+        canvas.drawPolyline(trajectories.nice_path, nicePathColour());
+    }
+
+    return canvas;
+}
+
+// The same picture as drawSeed from the trajectories in a file, with the
+// picture the file was made for scaled to params.width x params.height
+inline Canvas drawTrajectoryFile(Params const& params, TrajectoryFile const& file) {
+    Canvas canvas(params.width, params.height, backgroundColour());
+
+    const auto bounds = file.bounds();
+    const point size = bounds[1] - bounds[0];
+    const float scale_x = size.x > 0 ? params.width / size.x : 1.f;
+    const float scale_y = size.y > 0 ? params.height / size.y : 1.f;
+
+    std::vector<point> points;
+    auto draw = [&](const std::size_t i, Rgba const& colour) {
+        file.decode(i, points);
+        for (point& p : points) {
+            p = point((p.x - bounds[0].x) * scale_x, (p.y - bounds[0].y) * scale_y);
+        }
+        canvas.drawPolyline(points, colour);
+    };
+
+    {
+        profile::ScopedTimer draw_timer ("draw trajectories");
+        for (std::size_t i = 0; i < file.size(); ++i) {
+            if (file.hasNicePath() && i == static_cast<std::size_t>(file.header().nice_path)) {
+                continue;
+            }
+            draw(i, gliderColour());
+        }
+    }
+
+    if (file.hasNicePath()) {
+        profile::ScopedTimer draw_timer ("draw nice path");
+        draw(file.header().nice_path, nicePathColour());
+    }
+
+    return canvas;
+}
+
+// The picture of drawSeed as an SVG, written while the gliders are
+// integrated. Returns false if the file could not be written.
+inline bool writeSeedSvg(Params const& params, const int seed, std::string const& path,
+                         const unsigned nr_threads = 1) {
+    profile::ScopedTimer timer ("write svg");
+    const auto bounds = imageBounds(params);
+
+    std::mt19937 rng(seed);
+    const System system(params.nr_planets, bounds, rng);
+
+    std::ofstream file(path);
+    SvgWriter svg(file, bounds, params.width, params.height, backgroundColour());
+    PolylineSimplifier simplifier;
+
+    svg.beginGroup(gliderColour());
+    forEachGliderChunk(params, system, seed, nr_threads, [&](TrajectoryPool const& trajectories) {
+        for (std::size_t i = 0; i < trajectories.size(); ++i) {
+            svg.polyline(simplifier.simplify(trajectories[i], params.svg_tolerance));
+        }
+    });
+
+    const auto nice_path = nicePathPoints(params, system, seed, nr_threads);
+    if (!nice_path.empty()) {
+        svg.beginGroup(nicePathColour(), 2.f);
+        svg.polyline(simplifier.simplify(nice_path, params.svg_tolerance));
+    }
+
+    svg.finish();
+    return static_cast<bool>(file);
+}
+
+// The same from trajectories that were integrated already, like the ones
+// the viewer shows. nice_path may be empty.
+inline bool writeTrajectorySvg(Params const& params,
+                               std::vector<std::vector<point>> const& trajectories,
+                               std::vector<point> const& nice_path, std::string const& path) {
+    profile::ScopedTimer timer ("write svg");
+
+    std::ofstream file(path);
+    SvgWriter svg(file, imageBounds(params), params.width, params.height, backgroundColour());
+    PolylineSimplifier simplifier;
+
+    svg.beginGroup(gliderColour());
+    for (auto const& points : trajectories) {
+        svg.polyline(simplifier.simplify(points, params.svg_tolerance));
+    }
+
+    if (!nice_path.empty()) {
+        svg.beginGroup(nicePathColour(), 2.f);
+        svg.polyline(simplifier.simplify(nice_path, params.svg_tolerance));
+    }
+
+    svg.finish();
+    return static_cast<bool>(file);
+}
+
+// The same from the trajectories in a file, scaled like drawTrajectoryFile
+inline bool writeTrajectoryFileSvg(Params const& params, TrajectoryFile const& file,
+                                   std::string const& path) {
+    profile::ScopedTimer timer ("write svg");
+
+    std::ofstream out(path);
+    SvgWriter svg(out, file.bounds(), params.width, params.height, backgroundColour());
+    PolylineSimplifier simplifier;
+
+    // The tolerance is in pixels of the output, the trajectories are not
+    // scaled yet
+    const auto bounds = file.bounds();
+    const float scale = std::max((bounds[1].x - bounds[0].x) / params.width,
+                                 (bounds[1].y - bounds[0].y) / params.height);
+    const float tolerance = params.svg_tolerance * (scale > 0 ? scale : 1.f);
+
+    std::vector<point> points;
+    svg.beginGroup(gliderColour());
+    for (std::size_t i = 0; i < file.size(); ++i) {
+        if (file.hasNicePath() && i == static_cast<std::size_t>(file.header().nice_path)) {
+            continue;
+        }
+        file.decode(i, points);
+        svg.polyline(simplifier.simplify(points, tolerance));
+    }
+
+    if (file.hasNicePath()) {
+        file.decode(file.header().nice_path, points);
+        svg.beginGroup(nicePathColour(), 2.f);
+        svg.polyline(simplifier.simplify(points, tolerance));
+    }
+
+    svg.finish();
+    return static_cast<bool>(out);
+}
+
+// The picture of drawSeed with the gliders counted into a density buffer
+// and tone mapped, integrated a chunk at a time
+inline Canvas renderSeedDensity(Params const& params, const int seed,
+                                const unsigned nr_threads = 1) {
+    std::mt19937 rng(seed);
+    const System system(params.nr_planets, imageBounds(params), rng);
+
+    std::vector<DensityBuffer> buffers(parallel::threadCountFor(1024, nr_threads),
+                                       DensityBuffer(params.width, params.height));
+    auto identity = [](point const& p) { return p; };
+    {
+        profile::ScopedTimer accumulate_timer ("accumulate density");
+        forEachGliderChunk(params, system, seed, nr_threads, [&](TrajectoryPool const& chunk) {
+            accumulateDensity(chunk, identity, buffers);
+        });
+        for (std::size_t t = 1; t < buffers.size(); ++t) buffers[0] += buffers[t];
+    }
+
+    Canvas canvas = toneMap(buffers[0], params.tone_map, params.exposure,
+                            backgroundColour(), gliderColour());
+    canvas.drawPolyline(nicePathPoints(params, system, seed, nr_threads), nicePathColour());
+    return canvas;
+}
+
+// The same from the trajectories in a file, scaled like drawTrajectoryFile
+inline Canvas drawTrajectoryFileDensity(Params const& params, TrajectoryFile const& file,
+                                        const unsigned nr_threads = 1) {
+    const auto bounds = file.bounds();
+    const point size = bounds[1] - bounds[0];
+    const float scale_x = size.x > 0 ? params.width / size.x : 1.f;
+    const float scale_y = size.y > 0 ? params.height / size.y : 1.f;
+    auto transform = [&](point const& p) {
+        return point((p.x - bounds[0].x) * scale_x, (p.y - bounds[0].y) * scale_y);
+    };
+
+    std::vector<DensityBuffer> buffers(parallel::threadCountFor(file.size(), nr_threads),
+                                       DensityBuffer(params.width, params.height));
+    {
+        profile::ScopedTimer accumulate_timer ("accumulate density");
+        const std::size_t nice_path = file.hasNicePath() ? file.header().nice_path : -1;
+        accumulateDensity(file, transform, buffers, nice_path);
+        for (std::size_t t = 1; t < buffers.size(); ++t) buffers[0] += buffers[t];
+    }
+
+    Canvas canvas = toneMap(buffers[0], params.tone_map, params.exposure,
+                            backgroundColour(), gliderColour());
+    if (file.hasNicePath()) {
+        std::vector<point> points;
+        file.decode(file.header().nice_path, points);
+        for (point& p : points) p = transform(p);
+        canvas.drawPolyline(points, nicePathColour());
+    }
+    return canvas;
+}
+
+// The picture of drawSeed at params.scale times the size, rendered in
+// tiles and written to path a row at a time. trajectories is a
+// SeedTrajectories or a TrajectoryFile made for the rectangle bounds, with
+// the nice path at index nice_path.
+template <typename Trajectories>
+bool saveTiled(Params const& params, Trajectories const& trajectories,
+               const std::size_t nice_path, std::array<point, 2> const& bounds,
+               std::string const& path, const unsigned nr_threads) {
+    TiledRenderOptions options;
+    options.width = static_cast<unsigned>(std::lround(params.width * params.scale));
+    options.height = static_cast<unsigned>(std::lround(params.height * params.scale));
+    options.tile_size = params.tile_size;
+    options.supersample = params.supersample;
+    options.line_width = params.line_width * params.scale;
+    options.background = backgroundColour();
+    options.colour = gliderColour();
+    options.highlight_colour = nicePathColour();
+    options.nr_threads = nr_threads;
+
+    RowImageWriter writer(path, options.width, options.height);
+    renderTiled(trajectories, nice_path, bounds, options, writer);
+    return writer.finish();
+}
+
+inline Canvas renderSeed(Params const& params, const int seed, const unsigned nr_threads = 1) {
+    profile::ScopedTimer timer ("render seed");
+    return drawSeed(params, integrateSeed(params, seed, nr_threads));
+}
+
+inline bool saveCanvas(Canvas const& canvas, std::string const& path) {
+    profile::ScopedTimer timer ("encode png");
+    const auto pixels = canvas.toRgba8();
+    sf::Image image;
+    image.create(canvas.width(), canvas.height(), pixels.data());
+    return image.saveToFile(path);
+}
+
+// Renders all seeds in [params.seed, params.last_seed], one seed per thread,
+// to pngs or with params.save_svg to SVGs. Tiled pictures are rendered one
+// after the other, each with all threads.
+// Returns the number of files that could not be read or written.
+inline int runHeadless(Params const& params) {
+    namespace fs = boost::filesystem;
+
+    const fs::path output_dir(params.output_dir);
+    if (!fs::exists(output_dir)) {
+        fs::create_directories(output_dir);
+    }
+
+    const int first = std::min(params.seed, params.last_seed);
+    const std::size_t nr_seeds = std::abs(params.last_seed - params.seed) + 1;
+
+    std::atomic<int> failures {0};
+
+    parallel::forEach(nr_seeds, [&](unsigned, const std::size_t i) {
+        const int seed = first + static_cast<int>(i);
+
+        std::stringstream name;
+        name << "glider_" << seed;
+        std::string path = (output_dir / (name.str() + ".png")).string();
+        const std::string trajectory_name = name.str() + ".traj";
+
+        TrajectoryFile file;
+        if (!params.trajectory_dir.empty()) {
+            const std::string in = (fs::path(params.trajectory_dir) / trajectory_name).string();
+            if (!file.open(in)) {
+                ++failures;
+                printLine("failed to read " + in);
+                return;
+            }
+        }
+
+        // Integrates the seed and saves the trajectories if asked to
+        auto integrate = [&](const unsigned nr_threads) {
+            SeedTrajectories trajectories = integrateSeed(params, seed, nr_threads);
+            if (params.save_trajectories) {
+                const std::string out = (output_dir / trajectory_name).string();
+                const bool saved = saveTrajectories(params, seed, trajectories, out);
+                if (!saved) ++failures;
+                printLine((saved ? "wrote " : "failed to write ") + out);
+            }
+            return trajectories;
+        };
+
+        auto render = [&]() -> Canvas {
+            profile::ScopedTimer timer ("render seed");
+            if (file.isOpen()) return drawTrajectoryFile(params, file);
+            return drawSeed(params, integrate(1));
+        };
+
+        bool ok;
+        if (params.save_svg) {
+            path = (output_dir / (name.str() + ".svg")).string();
+            ok = file.isOpen() ? writeTrajectoryFileSvg(params, file, path)
+                               : writeSeedSvg(params, seed, path);
+        } else if (params.tiled) {
+            profile::ScopedTimer timer ("render seed");
+            path = (output_dir / (name.str() + '.' + RowImageWriter::extension())).string();
+            if (file.isOpen()) {
+                const std::size_t nice_path = file.hasNicePath() ? file.header().nice_path : -1;
+                ok = saveTiled(params, file, nice_path, file.bounds(), path, params.nr_threads);
+            } else {
+                const SeedTrajectories trajectories = integrate(params.nr_threads);
+                ok = saveTiled(params, trajectories, trajectories.gliders.size(),
+                               imageBounds(params), path, params.nr_threads);
+            }
+        } else if (params.density) {
+            profile::ScopedTimer timer ("render seed");
+            const Canvas canvas = file.isOpen() ? drawTrajectoryFileDensity(params, file)
+                                                : renderSeedDensity(params, seed);
+            ok = saveCanvas(canvas, path);
+        } else {
+            ok = saveCanvas(render(), path);
+        }
+        if (!ok) ++failures;
+        printLine((ok ? "wrote " : "failed to write ") + path);
+    }, params.tiled ? 1 : params.nr_threads);
+
+    if (!params.trace_file.empty() && !profile::writeChromeTrace(params.trace_file)) {
+        std::cerr << "failed to write " << params.trace_file << '\n';
+    }
+
+    return failures;
+}
+
+// Renders the animation of params.seed over params.frames frames, see
+// sweep.hpp, to output_dir/frame_<n>.png. The gliders start at the same
+// places in every frame. With many planets they go through a BarnesHut tree
+// that is refitted from frame to frame instead of rebuilt, while the
+// planets stay close to where it was built. Every frame is encoded while
+// the next one is integrated.
+// Returns the number of frames that could not be written.
+inline int runSweep(Params const& params) {
+    namespace fs = boost::filesystem;
+
+    const fs::path output_dir(params.output_dir);
+    if (!fs::exists(output_dir)) {
+        fs::create_directories(output_dir);
+    }
+
+    const auto bounds = imageBounds(params);
+    std::mt19937 rng(params.seed);
+    const System base(params.nr_planets, bounds, rng);
+    const auto starts = gliderStarts(params.nr_gliders, params.seed, bounds, params.sampling);
+
+    SweepSchedule schedule;
+    schedule.nr_frames = params.frames;
+    schedule.spiral_from = params.spiral_factor;
+    schedule.spiral_to = params.spiral_to;
+    schedule.mass_to = params.mass_to;
+    schedule.drift = params.drift;
+
+    // Below this many planets the exact fields are faster than the tree
+    const std::size_t min_tree_planets = 64;
+    const float theta = params.backend_options.theta;
+    const float max_drift = std::max(params.width, params.height) / 200.f;
+    std::unique_ptr<BarnesHut> tree;
+    NicePathTracker tracker;
+    int failures = 0;
+
+    parallel::pipeline(params.frames, [&](const std::size_t frame) {
+        profile::ScopedTimer timer ("render frame");
+        const SweepFrame f = sweepFrame(schedule, frame);
+        const System system(sweepPlanets(base.planets(), schedule, frame, params.seed), bounds);
+
+        SeedTrajectories trajectories;
+        auto integrate = [&](auto const& field, auto const& nice_path_field) {
+            integrator::withMethod(params.step_method, [&](auto step) {
+                generateGliderTrajectories<decltype(step)>(starts, field, f.spiral_factor,
+                                                           params.max_steps, trajectories.gliders,
+                                                           params.nr_threads);
+            });
+            if (params.nice_path_seed == 0) return;
+            const NicePath path = tracker.next(system, nice_path_field, f.spiral_factor,
+                                               params.max_steps, bounds, params.nice_path_seed,
+                                               params.search, params.nr_threads,
+                                               params.nice_path_attempts);
+            trajectories.nice_path = generateGliderTrajectory(path.start, nice_path_field,
+                                                              f.spiral_factor, params.max_steps,
+                                                              path.ccw);
+        };
+
+        if (system.planets().size() >= min_tree_planets) {
+            if (!tree || !tree->refit(system, max_drift)) {
+                tree.reset(new BarnesHut(system, theta));
+            }
+            integrate(*tree, *tree);
+        } else {
+            // The nice path goes through the system rather than the
+            // specialized field, which would be instantiated once more
+            withExactField(system, f.spiral_factor, [&](auto const& field) {
+                integrate(field, system);
+            });
+        }
+        return drawSeed(params, trajectories);
+    }, [&](const std::size_t frame, Canvas const& canvas) {
+        std::stringstream name;
+        name << "frame_" << std::setw(5) << std::setfill('0') << frame << ".png";
+        const std::string path = (output_dir / name.str()).string();
+        const bool ok = saveCanvas(canvas, path);
+        if (!ok) ++failures;
+        printLine((ok ? "wrote " : "failed to write ") + path);
+    });
+
+    if (!params.trace_file.empty() && !profile::writeChromeTrace(params.trace_file)) {
+        std::cerr << "failed to write " << params.trace_file << '\n';
+    }
+
+    return failures;
+}
+
+#endif // HEADLESS_HPP
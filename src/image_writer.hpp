@@ -0,0 +1,128 @@
+#ifndef IMAGE_WRITER_HPP
+#define IMAGE_WRITER_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#ifdef GLIDERS_PNG
+#include <csetjmp>
+#include <png.h>
+#endif
+
+// Image files written a row at a time, top to bottom, for pictures that are
+// too large to be held in memory as a whole. Rows are 8 bit rgb. ok() is
+// false once anything could not be written, finish() completes the file
+// and is called by the destructor otherwise.
+
+class PpmWriter {
+    std::FILE* file;
+    unsigned width_;
+    bool good;
+
+public:
+    PpmWriter(std::string const& path, const unsigned width, const unsigned height)
+        : file(std::fopen(path.c_str(), "wb")), width_(width), good(file != nullptr) {
+        if (good) good = std::fprintf(file, "P6\n%u %u\n255\n", width, height) > 0;
+    }
+
+    PpmWriter(PpmWriter const&) = delete;
+    PpmWriter& operator=(PpmWriter const&) = delete;
+    ~PpmWriter() { finish(); }
+
+    static const char* extension() { return "ppm"; }
+
+    bool ok() const { return good; }
+
+    void writeRow(const std::uint8_t* rgb) {
+        if (good) good = std::fwrite(rgb, 3, width_, file) == width_;
+    }
+
+    bool finish() {
+        if (file) {
+            if (std::fclose(file) != 0) good = false;
+            file = nullptr;
+        }
+        return good;
+    }
+};
+
+#ifdef GLIDERS_PNG
+
+// The same as a png, with libpng. Only available in builds that define
+// GLIDERS_PNG and link libpng.
+class PngWriter {
+    std::FILE* file;
+    png_structp png = nullptr;
+    png_infop info = nullptr;
+    bool good;
+
+public:
+    PngWriter(std::string const& path, const unsigned width, const unsigned height)
+        : file(std::fopen(path.c_str(), "wb")), good(file != nullptr) {
+        if (!good) return;
+        png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+        if (png) info = png_create_info_struct(png);
+        if (!info) {
+            good = false;
+            return;
+        }
+        if (setjmp(png_jmpbuf(png))) {
+            good = false;
+            return;
+        }
+        png_init_io(png, file);
+        // The default compression and filter search take longer than the
+        // rendering, for files only about as large
+        png_set_compression_level(png, 3);
+        png_set_filter(png, 0, PNG_FILTER_SUB);
+        png_set_IHDR(png, info, width, height, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
+                     PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+        png_write_info(png, info);
+    }
+
+    PngWriter(PngWriter const&) = delete;
+    PngWriter& operator=(PngWriter const&) = delete;
+    ~PngWriter() { finish(); }
+
+    static const char* extension() { return "png"; }
+
+    bool ok() const { return good; }
+
+    void writeRow(const std::uint8_t* rgb) {
+        if (!good) return;
+        if (setjmp(png_jmpbuf(png))) {
+            good = false;
+            return;
+        }
+        png_write_row(png, const_cast<png_bytep>(rgb));
+    }
+
+    bool finish() {
+        if (png) {
+            if (good && !setjmp(png_jmpbuf(png))) {
+                png_write_end(png, nullptr);
+            } else {
+                good = false;
+            }
+            png_destroy_write_struct(&png, &info);
+            png = nullptr;
+        }
+        if (file) {
+            if (std::fclose(file) != 0) good = false;
+            file = nullptr;
+        }
+        return good;
+    }
+};
+
+// The writer for pictures of any size, png where libpng is available
+using RowImageWriter = PngWriter;
+
+#else
+
+using RowImageWriter = PpmWriter;
+
+#endif // GLIDERS_PNG
+
+#endif // IMAGE_WRITER_HPP
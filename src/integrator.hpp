@@ -1,6 +1,11 @@
 #ifndef INTEGRATOR_HPP
 #define INTEGRATOR_HPP
 
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+
 namespace integrator {
     template <typename VectorSpace, typename GradientFunc, typename Scalar>
     VectorSpace explicitEuler(const VectorSpace start, GradientFunc f, const Scalar stepsize) {
@@ -26,6 +31,123 @@ namespace integrator {
 
         return start + (k1 + 2 * k2 + 2 * k3 + k4) / 6;
     }
+
+    // One Dormand-Prince 5(4) step. Returns the fifth order solution and
+    // stores the difference to the embedded fourth order one in error.
+    template <typename VectorSpace, typename GradientFunc, typename Scalar>
+    VectorSpace dormandPrince(const VectorSpace start, GradientFunc f, const Scalar stepsize,
+                              VectorSpace& error) {
+        const auto k1 = stepsize * f(start);
+        const auto k2 = stepsize * f(start + k1 * Scalar(1./5));
+        const auto k3 = stepsize * f(start + k1 * Scalar(3./40) + k2 * Scalar(9./40));
+        const auto k4 = stepsize * f(start + k1 * Scalar(44./45) - k2 * Scalar(56./15)
+                                     + k3 * Scalar(32./9));
+        const auto k5 = stepsize * f(start + k1 * Scalar(19372./6561) - k2 * Scalar(25360./2187)
+                                     + k3 * Scalar(64448./6561) - k4 * Scalar(212./729));
+        const auto k6 = stepsize * f(start + k1 * Scalar(9017./3168) - k2 * Scalar(355./33)
+                                     + k3 * Scalar(46732./5247) + k4 * Scalar(49./176)
+                                     - k5 * Scalar(5103./18656));
+
+        const VectorSpace next = start + k1 * Scalar(35./384) + k3 * Scalar(500./1113)
+            + k4 * Scalar(125./192) - k5 * Scalar(2187./6784) + k6 * Scalar(11./84);
+
+        const auto k7 = stepsize * f(next);
+
+        error = k1 * Scalar(71./57600) - k3 * Scalar(71./16695) + k4 * Scalar(71./1920)
+            - k5 * Scalar(17253./339200) + k6 * Scalar(22./525) - k7 * Scalar(1./40);
+
+        return next;
+    }
+
+    // Takes one Dormand-Prince step that keeps norm(error) below tolerance,
+    // retrying with smaller steps as needed but never going below
+    // min_stepsize. On return, taken holds the step size that was used,
+    // error_norm its error estimate, which only exceeds tolerance if even
+    // min_stepsize was not enough, and stepsize the suggested size for the
+    // next step.
+    template <typename VectorSpace, typename GradientFunc, typename Scalar, typename Norm>
+    VectorSpace adaptiveDormandPrince(const VectorSpace start, GradientFunc f,
+                                      Scalar& stepsize, Scalar& taken, Scalar& error_norm,
+                                      const Scalar tolerance, Norm norm,
+                                      const Scalar min_stepsize, const Scalar max_stepsize) {
+        for (;;) {
+            VectorSpace error;
+            const VectorSpace next = dormandPrince(start, f, stepsize, error);
+            error_norm = norm(error);
+
+            // Usual controller with safety factor, growth limited to 5x and
+            // shrinking to 0.2x per step.
+            const Scalar factor = error_norm > 0
+                ? Scalar(0.9) * std::pow(tolerance / error_norm, Scalar(0.2))
+                : Scalar(5);
+            const Scalar new_stepsize =
+                std::min(max_stepsize, std::max(min_stepsize,
+                    stepsize * std::min(Scalar(5), std::max(Scalar(0.2), factor))));
+
+            if (error_norm <= tolerance || stepsize <= min_stepsize) {
+                taken = stepsize;
+                stepsize = new_stepsize;
+                return next;
+            }
+
+            stepsize = new_stepsize;
+        }
+    }
+
+    // The fixed step integrators as types, so the one to use can be a
+    // template parameter and gets inlined into the stepping loop.
+    struct ExplicitEuler {
+        template <typename VectorSpace, typename GradientFunc, typename Scalar>
+        static VectorSpace step(const VectorSpace start, GradientFunc&& f, const Scalar stepsize) {
+            return explicitEuler(start, f, stepsize);
+        }
+    };
+
+    struct Midpoint {
+        template <typename VectorSpace, typename GradientFunc, typename Scalar>
+        static VectorSpace step(const VectorSpace start, GradientFunc&& f, const Scalar stepsize) {
+            return midpoint(start, f, stepsize);
+        }
+    };
+
+    struct RungeKutta4 {
+        template <typename VectorSpace, typename GradientFunc, typename Scalar>
+        static VectorSpace step(const VectorSpace start, GradientFunc&& f, const Scalar stepsize) {
+            return rungeKutta4(start, f, stepsize);
+        }
+    };
+
+    enum class Method { euler, midpoint, rk4 };
+
+    inline std::istream& operator>>(std::istream& in, Method& method) {
+        std::string name;
+        in >> name;
+        if (name == "euler") method = Method::euler;
+        else if (name == "midpoint") method = Method::midpoint;
+        else if (name == "rk4") method = Method::rk4;
+        else in.setstate(std::ios::failbit);
+        return in;
+    }
+
+    inline std::ostream& operator<<(std::ostream& out, const Method method) {
+        switch (method) {
+        case Method::euler: return out << "euler";
+        case Method::midpoint: return out << "midpoint";
+        case Method::rk4: return out << "rk4";
+        }
+        return out;
+    }
+
+    // Calls func with the integrator type for method, so a choice made at
+    // runtime picks one of the instantiations once.
+    template <typename Func>
+    void withMethod(const Method method, Func&& func) {
+        switch (method) {
+        case Method::euler: func(ExplicitEuler()); break;
+        case Method::midpoint: func(Midpoint()); break;
+        case Method::rk4: func(RungeKutta4()); break;
+        }
+    }
 }
 
 #endif // INTEGRATOR_HPP
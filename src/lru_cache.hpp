@@ -0,0 +1,55 @@
+#ifndef LRU_CACHE_HPP
+#define LRU_CACHE_HPP
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <memory>
+#include <utility>
+
+// Keeps the values for the capacity most recently used keys. Values are
+// created on a miss by a factory and handed out as shared pointers, so a
+// value that is still in use somewhere stays alive after being evicted.
+
+template <typename Key, typename Value>
+class LruCache {
+    using Entry = std::pair<Key, std::shared_ptr<Value>>;
+
+    std::size_t capacity;
+    std::list<Entry> entries; // most recently used first
+    std::map<Key, typename std::list<Entry>::iterator> index;
+
+public:
+    explicit LruCache(const std::size_t capacity) : capacity(capacity > 0 ? capacity : 1) {}
+
+    // Value for key, made with make() if it is not in the cache, which may
+    // evict the least recently used entry.
+    template <typename Make>
+    std::shared_ptr<Value> get(Key const& key, Make&& make) {
+        auto found = index.find(key);
+        if (found != index.end()) {
+            entries.splice(entries.begin(), entries, found->second);
+            return found->second->second;
+        }
+
+        std::shared_ptr<Value> value = make();
+        if (entries.size() >= capacity) {
+            index.erase(entries.back().first);
+            entries.pop_back();
+        }
+        entries.emplace_front(key, std::move(value));
+        index[key] = entries.begin();
+        return entries.front().second;
+    }
+
+    bool contains(Key const& key) const { return index.count(key) > 0; }
+
+    std::size_t size() const { return entries.size(); }
+
+    void clear() {
+        entries.clear();
+        index.clear();
+    }
+};
+
+#endif // LRU_CACHE_HPP
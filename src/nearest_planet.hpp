@@ -0,0 +1,193 @@
+#ifndef NEAREST_PLANET_HPP
+#define NEAREST_PLANET_HPP
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "point.hpp"
+#include "system.hpp"
+
+// Answers "which planet is closest to this point" without looking at every
+// planet. The area around the planets is split into a uniform grid of
+// about one cell per planet, and every cell keeps a list of the planets
+// that can be the closest one for some point inside of it. A query scans
+// only its cell's list, which holds a handful of planets no matter how
+// many there are overall.
+//
+// The lists are in index order and the scan is the same as a scan over all
+// planets, so ties go to the lowest index and the answer is exactly that
+// of the linear scan. Points outside of the grid use the linear scan.
+
+class NearestPlanetIndex {
+    std::vector<point> positions;
+
+    point origin;
+    float cell_size = 1;
+    long nx = 0, ny = 0;
+
+    // Per cell: planets that can be the closest one, in CSR layout
+    std::vector<std::uint32_t> candidate_offsets;
+    std::vector<std::uint32_t> candidates;
+
+    long cell(const long ix, const long iy) const { return iy * nx + ix; }
+
+    std::size_t scan(const std::uint32_t* begin, const std::uint32_t* end,
+                     point const& p) const {
+        float sq_lowest_dist = std::numeric_limits<float>::max();
+        std::size_t closest = 0;
+        for (const std::uint32_t* it = begin; it != end; ++it) {
+            const point r = positions[*it] - p;
+            if (r.sqmag() < sq_lowest_dist) {
+                sq_lowest_dist = r.sqmag();
+                closest = *it;
+            }
+        }
+        return closest;
+    }
+
+    std::size_t scanAll(point const& p) const {
+        float sq_lowest_dist = std::numeric_limits<float>::max();
+        std::size_t closest = 0;
+        for (std::size_t i = 0; i < positions.size(); ++i) {
+            const point r = positions[i] - p;
+            if (r.sqmag() < sq_lowest_dist) {
+                sq_lowest_dist = r.sqmag();
+                closest = i;
+            }
+        }
+        return closest;
+    }
+
+    // Calls func(planet) for every planet in the cells with a Chebyshev
+    // distance of exactly ring from (cx, cy).
+    template <typename Func>
+    void forRing(const long cx, const long cy, const long ring,
+                 std::vector<std::uint32_t> const& offsets,
+                 std::vector<std::uint32_t> const& planets, Func&& func) const {
+        for (long iy = std::max(0l, cy - ring); iy <= std::min(ny - 1, cy + ring); ++iy) {
+            const bool edge_row = iy == cy - ring || iy == cy + ring;
+            const long step = edge_row || ring == 0 ? 1 : 2 * ring;
+            for (long ix = cx - ring; ix <= cx + ring; ix += step) {
+                if (ix < 0 || ix >= nx) continue;
+                const long c = cell(ix, iy);
+                for (std::uint32_t k = offsets[c]; k < offsets[c + 1]; ++k) {
+                    func(planets[k]);
+                }
+            }
+        }
+    }
+
+    void build() {
+        // Planets per cell, to find the candidates without an O(n^2) scan
+        std::vector<std::uint32_t> bucket_offsets(nx * ny + 1, 0);
+        std::vector<std::uint32_t> buckets(positions.size());
+        std::vector<long> planet_cell(positions.size());
+        for (std::size_t i = 0; i < positions.size(); ++i) {
+            const point rel = (positions[i] - origin) / cell_size;
+            const long ix = std::min(nx - 1, std::max(0l, static_cast<long>(rel.x)));
+            const long iy = std::min(ny - 1, std::max(0l, static_cast<long>(rel.y)));
+            planet_cell[i] = cell(ix, iy);
+            ++bucket_offsets[planet_cell[i] + 1];
+        }
+        for (long c = 0; c < nx * ny; ++c) {
+            bucket_offsets[c + 1] += bucket_offsets[c];
+        }
+        {
+            std::vector<std::uint32_t> fill(bucket_offsets.begin(), bucket_offsets.end() - 1);
+            for (std::size_t i = 0; i < positions.size(); ++i) {
+                buckets[fill[planet_cell[i]]++] = i;
+            }
+        }
+
+        const float half_diagonal = cell_size * std::sqrt(2.f) / 2;
+        const long max_ring = std::max(nx, ny);
+
+        candidate_offsets.assign(1, 0);
+        candidates.clear();
+        std::vector<std::uint32_t> list;
+
+        for (long cy = 0; cy < ny; ++cy) {
+            for (long cx = 0; cx < nx; ++cx) {
+                const point centre = origin + point((cx + 0.5f) * cell_size,
+                                                    (cy + 0.5f) * cell_size);
+
+                // Distance from the centre to its closest planet. Everything
+                // in ring k is at least (k - 0.5) cells away.
+                float sq_closest = std::numeric_limits<float>::max();
+                for (long ring = 0; ring <= max_ring; ++ring) {
+                    const float ring_dist = (ring - 0.5f) * cell_size;
+                    if (ring > 0 && ring_dist * ring_dist > sq_closest) break;
+                    forRing(cx, cy, ring, bucket_offsets, buckets, [&](const std::uint32_t i) {
+                        sq_closest = std::min(sq_closest, (positions[i] - centre).sqmag());
+                    });
+                }
+
+                // For any point p in the cell, the closest planet is at most
+                // closest + half_diagonal away from p, and so at most
+                // closest + 2 * half_diagonal away from the centre. With a
+                // little slack for rounding.
+                const float radius =
+                    (std::sqrt(sq_closest) + 2 * half_diagonal) * 1.001f + 1e-3f;
+                const float sq_radius = radius * radius;
+                const long rings = static_cast<long>(std::ceil(radius / cell_size + 0.5f));
+
+                list.clear();
+                for (long ring = 0; ring <= std::min(rings, max_ring); ++ring) {
+                    forRing(cx, cy, ring, bucket_offsets, buckets, [&](const std::uint32_t i) {
+                        if ((positions[i] - centre).sqmag() <= sq_radius) list.push_back(i);
+                    });
+                }
+                std::sort(list.begin(), list.end());
+
+                candidates.insert(candidates.end(), list.begin(), list.end());
+                candidate_offsets.push_back(candidates.size());
+            }
+        }
+    }
+
+public:
+    // The grid covers bounds and all of the planets.
+    NearestPlanetIndex(std::vector<Planet> const& planets, std::array<point, 2> const& bounds) {
+        point lo = bounds[0], hi = bounds[1];
+        for (auto const& p : planets) {
+            positions.push_back(p.pos);
+            lo = point(std::min(lo.x, p.pos.x), std::min(lo.y, p.pos.y));
+            hi = point(std::max(hi.x, p.pos.x), std::max(hi.y, p.pos.y));
+        }
+        if (positions.empty()) return;
+
+        const float width = std::max(hi.x - lo.x, 1.f);
+        const float height = std::max(hi.y - lo.y, 1.f);
+        cell_size = std::sqrt(width * height / positions.size());
+        origin = lo;
+        nx = static_cast<long>(std::ceil(width / cell_size)) + 1;
+        ny = static_cast<long>(std::ceil(height / cell_size)) + 1;
+
+        build();
+    }
+
+    NearestPlanetIndex(System const& system, std::array<point, 2> const& bounds)
+        : NearestPlanetIndex(system.planets(), bounds) {}
+
+    std::size_t size() const { return positions.size(); }
+
+    point const& position(const std::size_t i) const { return positions[i]; }
+
+    // Index of the planet closest to p, the lowest one on ties. Must not be
+    // called without planets.
+    std::size_t closest(point const& p) const {
+        const point rel = (p - origin) / cell_size;
+        if (!(rel.x >= 0 && rel.y >= 0 && rel.x < nx && rel.y < ny)) {
+            return scanAll(p);
+        }
+
+        const long c = cell(static_cast<long>(rel.x), static_cast<long>(rel.y));
+        return scan(candidates.data() + candidate_offsets[c],
+                    candidates.data() + candidate_offsets[c + 1], p);
+    }
+};
+
+#endif // NEAREST_PLANET_HPP
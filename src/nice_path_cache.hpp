@@ -0,0 +1,356 @@
+#ifndef NICE_PATH_CACHE_HPP
+#define NICE_PATH_CACHE_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "fast_math.hpp"
+#include "glider.hpp"
+#include "point.hpp"
+#include "profile.hpp"
+#include "search_strategy.hpp"
+
+// Nice paths found before, kept in a file across runs. A nice path only
+// depends on the parameters in NicePathKey, so coming back to a seed does
+// not need a search.
+//
+// The file is a hash table that is mapped into memory: the
+// NicePathCacheHeader, then capacity slots with linear probing. Entries
+// are never removed, and the table is rehashed into twice the capacity
+// when it gets three quarters full. A file written with another
+// nice_path_version, whose searches might have found other paths, or
+// that is not a valid cache is cleared on open. Like trajectory files,
+// it is in the byte order of the machine that wrote it.
+//
+// Only one program can have a cache file open at a time, which it locks,
+// but it can be used from any number of threads.
+
+struct NicePathKey {
+    std::int32_t seed;
+    std::int32_t nice_path_seed;
+    std::uint32_t nr_planets;
+    std::uint32_t max_steps;
+    float spiral_factor;
+    // Rectangle of the search, min and max corner
+    float bounds[4];
+    std::uint32_t search; // SearchStrategy
+    // Starts of the random search
+    std::uint32_t attempts;
+    // 0 for the exact fields, other values for approximations that the
+    // caller tells apart
+    std::uint32_t field;
+    // Settings of the approximations, 0 for the fields that don't have them
+    float grid_resolution;
+    float theta;
+    // fastmath::level, which changes the paths slightly
+    std::uint32_t fast_math;
+};
+
+static_assert(sizeof(NicePathKey) == 60, "NicePathKey must not have padding");
+
+inline NicePathKey nicePathKey(const int seed, const int nice_path_seed,
+                               const std::size_t nr_planets, const std::size_t max_steps,
+                               const float spiral_factor, std::array<point, 2> const& bounds,
+                               const SearchStrategy search, const std::size_t attempts,
+                               const std::uint32_t field = 0,
+                               const float grid_resolution = 0, const float theta = 0) {
+    NicePathKey key;
+    std::memset(&key, 0, sizeof(key));
+    key.seed = seed;
+    key.nice_path_seed = nice_path_seed;
+    key.nr_planets = static_cast<std::uint32_t>(nr_planets);
+    key.max_steps = static_cast<std::uint32_t>(max_steps);
+    key.spiral_factor = spiral_factor;
+    key.bounds[0] = bounds[0].x;
+    key.bounds[1] = bounds[0].y;
+    key.bounds[2] = bounds[1].x;
+    key.bounds[3] = bounds[1].y;
+    key.search = static_cast<std::uint32_t>(search);
+    key.attempts = static_cast<std::uint32_t>(attempts);
+    key.field = field;
+    key.grid_resolution = grid_resolution;
+    key.theta = theta;
+    key.fast_math = static_cast<std::uint32_t>(fastmath::level);
+    return key;
+}
+
+struct NicePathCacheHeader {
+    static const std::uint32_t current_version = 3;
+
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t nice_path_version;
+    // Number of slots, a power of two
+    std::uint32_t capacity;
+    std::uint64_t size;
+};
+
+static_assert(sizeof(NicePathCacheHeader) == 24,
+              "NicePathCacheHeader must not have padding");
+
+namespace detail {
+    struct NicePathSlot {
+        static const std::uint32_t used = 1, ccw = 2;
+
+        NicePathKey key;
+        float start[2];
+        float score;
+        std::uint32_t flags;
+    };
+
+    static_assert(sizeof(NicePathSlot) == 76, "NicePathSlot must not have padding");
+
+    // FNV-1a over the bytes of the key
+    inline std::uint64_t hashKey(NicePathKey const& key) {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&key);
+        std::uint64_t hash = 14695981039346656037ull;
+        for (std::size_t i = 0; i < sizeof(key); ++i) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+        return hash;
+    }
+}
+
+class NicePathCache {
+    std::mutex mutex;
+    std::string path;
+    int fd = -1;
+    void* mapping = nullptr;
+    std::size_t mapping_size = 0;
+    NicePathCacheHeader* header = nullptr;
+    detail::NicePathSlot* slots = nullptr;
+
+    static std::size_t fileSize(const std::size_t capacity) {
+        return sizeof(NicePathCacheHeader) + capacity * sizeof(detail::NicePathSlot);
+    }
+
+    void unmap() {
+        if (mapping) munmap(mapping, mapping_size);
+        mapping = nullptr;
+        mapping_size = 0;
+        header = nullptr;
+        slots = nullptr;
+    }
+
+    void closeLocked() {
+        unmap();
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+    }
+
+    bool map(const std::size_t size) {
+        unmap();
+        void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED) return false;
+        mapping = data;
+        mapping_size = size;
+        header = static_cast<NicePathCacheHeader*>(mapping);
+        slots = reinterpret_cast<detail::NicePathSlot*>(
+            static_cast<char*>(mapping) + sizeof(NicePathCacheHeader));
+        return true;
+    }
+
+    bool valid(const std::size_t size) const {
+        if (size < sizeof(NicePathCacheHeader)) return false;
+        NicePathCacheHeader const* h = static_cast<NicePathCacheHeader const*>(mapping);
+        return std::memcmp(h->magic, "GNPC", 4) == 0 &&
+               h->version == NicePathCacheHeader::current_version &&
+               h->nice_path_version == nice_path_version &&
+               h->capacity > 0 && (h->capacity & (h->capacity - 1)) == 0 &&
+               size == fileSize(h->capacity) && h->size < h->capacity;
+    }
+
+    // An empty table of capacity slots, replacing whatever was in the file
+    bool reset(const std::size_t capacity) {
+        unmap();
+        const std::size_t size = fileSize(capacity);
+        if (ftruncate(fd, 0) != 0 || ftruncate(fd, size) != 0 || !map(size)) return false;
+        std::memcpy(header->magic, "GNPC", 4);
+        header->version = NicePathCacheHeader::current_version;
+        header->nice_path_version = nice_path_version;
+        header->capacity = static_cast<std::uint32_t>(capacity);
+        header->size = 0;
+        return true;
+    }
+
+    // The slot of key, or the empty one where it would go. Null if every
+    // slot is used by other keys, which the size keeps from happening
+    // unless the file was left inconsistent.
+    detail::NicePathSlot* slot(NicePathKey const& key) const {
+        const std::size_t mask = header->capacity - 1;
+        std::size_t i = detail::hashKey(key) & mask;
+        for (std::size_t probes = 0; probes < header->capacity; ++probes, i = (i + 1) & mask) {
+            detail::NicePathSlot& s = slots[i];
+            if (!(s.flags & detail::NicePathSlot::used) ||
+                std::memcmp(&s.key, &key, sizeof(key)) == 0) {
+                return &s;
+            }
+        }
+        return nullptr;
+    }
+
+    // Number of used slots, counted again
+    std::size_t countUsed() const {
+        std::size_t used = 0;
+        for (std::size_t i = 0; i < header->capacity; ++i) {
+            if (slots[i].flags & detail::NicePathSlot::used) ++used;
+        }
+        return used;
+    }
+
+    bool put(detail::NicePathSlot const& entry) {
+        detail::NicePathSlot* s = slot(entry.key);
+        if (!s) return false;
+        if (!(s->flags & detail::NicePathSlot::used)) ++header->size;
+        *s = entry;
+        return true;
+    }
+
+    // Builds the table of twice the capacity in <path>.tmp and only then
+    // renames it over the file, so the entries are never only in memory.
+    // The new file is locked before the rename, the old one is let go of
+    // after it.
+    bool grow() {
+        std::vector<detail::NicePathSlot> entries;
+        for (std::size_t i = 0; i < header->capacity; ++i) {
+            if (slots[i].flags & detail::NicePathSlot::used) entries.push_back(slots[i]);
+        }
+        const std::size_t capacity = 2 * static_cast<std::size_t>(header->capacity);
+
+        const std::string temporary = path + ".tmp";
+        const int new_fd = ::open(temporary.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (new_fd < 0) return false;
+        if (flock(new_fd, LOCK_EX | LOCK_NB) != 0) {
+            ::close(new_fd);
+            return false;
+        }
+
+        unmap();
+        const int old_fd = fd;
+        fd = new_fd;
+        bool ok = reset(capacity);
+        if (ok) {
+            for (auto const& entry : entries) ok = ok && put(entry);
+            ok = ok && msync(mapping, mapping_size, MS_SYNC) == 0 &&
+                std::rename(temporary.c_str(), path.c_str()) == 0;
+        }
+        ::close(old_fd);
+        if (!ok) ::unlink(temporary.c_str());
+        return ok;
+    }
+
+public:
+    NicePathCache() {}
+    NicePathCache(NicePathCache const&) = delete;
+    NicePathCache& operator=(NicePathCache const&) = delete;
+    ~NicePathCache() { close(); }
+
+    // Maps the cache file at path, which is made if it does not exist.
+    // Returns false if it can not be, or if another program has it open.
+    bool open(std::string const& path, const std::size_t initial_capacity = 1024) {
+        std::lock_guard<std::mutex> lock(mutex);
+        closeLocked();
+
+        this->path = path;
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) return false;
+        struct stat info;
+        if (flock(fd, LOCK_EX | LOCK_NB) != 0 || fstat(fd, &info) != 0) {
+            closeLocked();
+            return false;
+        }
+
+        // A program that died between marking a slot used and counting it
+        // leaves the size short, so it is counted again
+        const std::size_t size = static_cast<std::size_t>(info.st_size);
+        if (size >= sizeof(NicePathCacheHeader) && map(size) && valid(size)) {
+            header->size = countUsed();
+            return true;
+        }
+
+        std::size_t capacity = 1;
+        while (capacity < initial_capacity) capacity *= 2;
+        if (!reset(capacity)) {
+            closeLocked();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closeLocked();
+    }
+
+    bool isOpen() const { return mapping != nullptr; }
+
+    std::size_t size() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return header ? header->size : 0;
+    }
+
+    // Returns false if key is not in the cache
+    bool find(NicePathKey const& key, NicePath& path) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!header) return false;
+        detail::NicePathSlot const* s = slot(key);
+        if (!s || !(s->flags & detail::NicePathSlot::used)) return false;
+        path.start = point(s->start[0], s->start[1]);
+        path.ccw = s->flags & detail::NicePathSlot::ccw;
+        path.score = s->score;
+        return true;
+    }
+
+    void insert(NicePathKey const& key, NicePath const& path) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!header) return;
+        if (4 * (header->size + 1) > 3 * static_cast<std::size_t>(header->capacity) && !grow()) {
+            closeLocked();
+            return;
+        }
+
+        detail::NicePathSlot* s = slot(key);
+        if (!s && (!grow() || !(s = slot(key)))) {
+            closeLocked();
+            return;
+        }
+
+        // The flags go in after the rest, so a new slot that was only
+        // partly written when the program died is not marked used, and the
+        // size is only counted up once the slot is complete
+        const bool is_new = !(s->flags & detail::NicePathSlot::used);
+        s->key = key;
+        s->start[0] = path.start.x;
+        s->start[1] = path.start.y;
+        s->score = path.score;
+        std::atomic_thread_fence(std::memory_order_release);
+        s->flags = detail::NicePathSlot::used | (path.ccw ? detail::NicePathSlot::ccw : 0);
+        if (is_new) ++header->size;
+    }
+
+    // The path for key from the cache, or from compute(), which is then
+    // added. Works without a cache file too, then it always computes.
+    template <typename Compute>
+    NicePath get(NicePathKey const& key, Compute&& compute) {
+        NicePath path;
+        if (find(key, path)) {
+            profile::count(profile::Counter::nice_path_cache_hits);
+            return path;
+        }
+        path = compute();
+        insert(key, path);
+        return path;
+    }
+};
+
+#endif // NICE_PATH_CACHE_HPP
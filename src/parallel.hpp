@@ -0,0 +1,103 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace parallel {
+    inline unsigned defaultThreadCount() {
+        const unsigned n = std::thread::hardware_concurrency();
+        return n == 0 ? 1 : n;
+    }
+
+    // Number of threads forEach will actually use for n items, so callers
+    // can size their per-thread state up front.
+    inline unsigned threadCountFor(const std::size_t n, unsigned nr_threads,
+                                   const std::size_t chunk = 1) {
+        if (nr_threads == 0) nr_threads = defaultThreadCount();
+        return std::max(1u, std::min<unsigned>(nr_threads, (n + chunk - 1) / chunk));
+    }
+
+    // Calls func(thread_id, i) for every i in [0, n). Indices are handed out
+    // in chunks from a shared counter, so a thread that got cheap work keeps
+    // on pulling new indices instead of idling while the others finish.
+    //
+    // thread_id is in [0, nr_threads) and can be used to index per-thread
+    // state, which is then reduced by the caller after this returns.
+    template <typename Func>
+    void forEach(const std::size_t n, Func func,
+                 unsigned nr_threads = 0, const std::size_t chunk = 1) {
+        nr_threads = threadCountFor(n, nr_threads, chunk);
+
+        std::atomic<std::size_t> next {0};
+        std::vector<std::exception_ptr> errors(nr_threads);
+
+        auto worker = [&](const unsigned thread_id) {
+            try {
+                for (;;) {
+                    const std::size_t begin = next.fetch_add(chunk);
+                    if (begin >= n) break;
+                    const std::size_t end = std::min(n, begin + chunk);
+                    for (std::size_t i = begin; i < end; ++i) {
+                        func(thread_id, i);
+                    }
+                }
+            } catch (...) {
+                errors[thread_id] = std::current_exception();
+                next = n;
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (unsigned t = 1; t < nr_threads; ++t) {
+            threads.emplace_back(worker, t);
+        }
+        worker(0);
+        for (auto& t : threads) t.join();
+
+        for (auto const& e : errors) {
+            if (e) std::rethrow_exception(e);
+        }
+    }
+
+    // Calls produce(i) for every i in [0, n) in order, and consume(i, item)
+    // with what it returned on a thread of its own, also in order. So
+    // consume(i) runs while produce(i + 1) does, like encoding a frame
+    // while the next one is computed. At most one item waits to be
+    // consumed at any time.
+    template <typename Produce, typename Consume>
+    void pipeline(const std::size_t n, Produce produce, Consume consume) {
+        using Item = decltype(produce(std::size_t(0)));
+
+        std::thread consumer;
+        std::exception_ptr error;
+        auto wait = [&]() {
+            if (consumer.joinable()) consumer.join();
+            if (error) std::rethrow_exception(error);
+        };
+
+        try {
+            for (std::size_t i = 0; i < n; ++i) {
+                auto item = std::make_shared<Item>(produce(i));
+                wait();
+                consumer = std::thread([&error, &consume, item, i]() {
+                    try {
+                        consume(i, *item);
+                    } catch (...) {
+                        error = std::current_exception();
+                    }
+                });
+            }
+        } catch (...) {
+            if (consumer.joinable()) consumer.join();
+            throw;
+        }
+        wait();
+    }
+}
+
+#endif // PARALLEL_HPP
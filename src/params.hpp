@@ -0,0 +1,343 @@
+#ifndef PARAMS_HPP
+#define PARAMS_HPP
+
+#include <cstddef>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <boost/program_options.hpp>
+#include "density.hpp"
+#include "field_backend.hpp"
+#include "glider_starts.hpp"
+#include "integrator.hpp"
+#include "profile.hpp"
+#include "search_strategy.hpp"
+
+// Everything that used to be a global at the top of glider.cpp, so one
+// set of values can be passed around to the viewer and the headless
+// renderer alike. They come from the command line, a config file and a
+// preset, in that order of precedence, see parseCommandLine.
+
+struct Params {
+    unsigned width = 1800;
+    unsigned height = 1000;
+
+    int seed = 3;
+    std::size_t nr_planets = 10;
+    std::size_t nr_gliders = 1000;
+    std::size_t max_steps = 200;
+    float spiral_factor = 4.0f;
+    // Integrator of the gliders in the picture, the nice path always uses rk4
+    integrator::Method step_method = integrator::Method::rk4;
+    // Field the gliders are integrated through, with the options of the
+    // approximations. The nice path is always found in the exact field,
+    // except in the viewer.
+    Backend backend = Backend::exact;
+    BackendOptions backend_options;
+    // The viewer integrates with adaptive step sizes, which it starts with
+    // when adaptive is set, keeping the error of every step below
+    // adaptive_tolerance pixels
+    bool adaptive = false;
+    float adaptive_tolerance = 0.01f;
+
+    // Headless rendering of the seeds [seed, last_seed] into output_dir
+    bool headless = false;
+    int last_seed = 3;
+    std::string output_dir = "renders";
+    // Draws the nice path for this seed on top when not zero
+    int nice_path_seed = 0;
+    // Also writes every seed's trajectories to a .traj file in output_dir
+    bool save_trajectories = false;
+    // Writes SVGs instead of pngs, with the trajectories simplified to
+    // within svg_tolerance pixels
+    bool save_svg = false;
+    float svg_tolerance = 0.25f;
+    // Renders pictures of params.scale times the size in tiles, into files
+    // written a row at a time, with every pixel averaged over supersample^2
+    // samples. line_width is in pixels before scaling.
+    bool tiled = false;
+    float scale = 1.f;
+    unsigned supersample = 4;
+    unsigned tile_size = 256;
+    float line_width = 1.f;
+    // Counts the gliders into a density buffer and tone maps that, instead
+    // of blending them
+    bool density = false;
+    ToneMap tone_map = ToneMap::filmic;
+    float exposure = 0.08f;
+    // Renders an animation of params.seed in this many frames instead of
+    // the seeds, when not zero. Over the frames the spiral factor goes from
+    // spiral_factor to spiral_to, the planet masses are multiplied by 1 to
+    // mass_to and the planets move drift pixels each.
+    std::size_t frames = 0;
+    float spiral_to = 4.0f;
+    float mass_to = 1.f;
+    float drift = 0.f;
+    // Screening of the seeds over several machines, see seed_farm.hpp. A
+    // coordinator listens on farm_port when that is not zero, and keeps
+    // the best farm_top seeds in output_dir. Workers connect to the
+    // coordinator at farm_worker, host:port, when that is not empty.
+    unsigned short farm_port = 0;
+    std::string farm_worker;
+    std::size_t farm_chunk = 256;
+    std::size_t farm_top = 100;
+    unsigned thumbnail_width = 180;
+    // Seconds a worker gets for a range before it goes to another one
+    unsigned farm_timeout = 600;
+    // Draws the seeds from the .traj files in this directory instead of
+    // integrating them, when not empty
+    std::string trajectory_dir;
+    SearchStrategy search = SearchStrategy::random;
+    // Starts the random search tries
+    std::size_t nice_path_attempts = 1000;
+    // The viewer saves its screenshots and SVGs here
+    std::string screenshot_dir = "screenshots";
+    // Nice paths that were found before are taken from this file, see
+    // nice_path_cache.hpp, when not empty. In screenshot_dir unless given.
+    std::string nice_path_cache = "screenshots/nice_paths.cache";
+    GliderSampling sampling = GliderSampling::random;
+    // The viewer stops adding gliders after this many seconds, 0 for never
+    float time_budget = 0.f;
+    // 0 for all cores
+    unsigned nr_threads = 0;
+    // Chrome trace of the run, written on exit when not empty
+    std::string trace_file;
+};
+
+// Presets for common jobs, in the syntax of config files
+inline const char* presetOptions(std::string const& name) {
+    if (name == "draft") {
+        // Quick previews
+        return "gliders = 300\n"
+               "steps = 150\n"
+               "integrator = midpoint\n"
+               "search = coarse\n";
+    } else if (name == "poster") {
+        return "gliders = 4000\n"
+               "nice-path = 1\n"
+               "tiled = true\n"
+               "scale = 4\n"
+               "supersample = 4\n"
+               "line-width = 1.5\n";
+    } else if (name == "galaxy") {
+        // Many planets, where the exact field is too slow
+        return "planets = 2000\n"
+               "gliders = 2000\n"
+               "backend = barnes-hut\n"
+               "theta = 0.6\n"
+               "search = refine\n";
+    } else if (name == "screening") {
+        // Seed farms over millions of seeds
+        return "search = refine\n"
+               "farm-chunk = 512\n"
+               "top = 500\n"
+               "thumbnail-width = 120\n";
+    }
+    return nullptr;
+}
+
+// Fills params from the command line, and from the config file and the
+// preset it names. Options on the command line take precedence over the
+// config file, and those over the preset. Config files have an option per
+// line, as name = value without the dashes, and # for comments. Returns
+// false if the program should exit right away, e.g. after printing the
+// help. Throws boost::program_options::error on invalid input.
+inline bool parseCommandLine(const int argc, const char* const argv[], Params& params) {
+    namespace po = boost::program_options;
+
+    po::options_description desc("Options");
+    desc.add_options()
+        ("help,h", "print this help")
+        ("config", po::value<std::string>(),
+         "read options from this file, the command line takes precedence")
+        ("preset", po::value<std::string>(),
+         "start from the options of a preset: draft, poster, galaxy or screening")
+        ("width", po::value(&params.width)->default_value(params.width), "image width")
+        ("height", po::value(&params.height)->default_value(params.height), "image height")
+        ("seed,s", po::value(&params.seed)->default_value(params.seed), "planet seed")
+        ("planets", po::value(&params.nr_planets)->default_value(params.nr_planets),
+         "number of planets")
+        ("gliders", po::value(&params.nr_gliders)->default_value(params.nr_gliders),
+         "number of gliders")
+        ("steps", po::value(&params.max_steps)->default_value(params.max_steps),
+         "maximum number of steps per glider")
+        ("spiral", po::value(&params.spiral_factor)->default_value(params.spiral_factor),
+         "weight of the angular potential")
+        ("integrator", po::value(&params.step_method)->default_value(params.step_method),
+         "integrator of the gliders: euler, midpoint or rk4")
+        ("backend", po::value(&params.backend)->default_value(params.backend),
+         "field the gliders are integrated through: exact, grid or barnes-hut")
+        ("grid-resolution", po::value(&params.backend_options.grid_resolution)
+                                ->default_value(params.backend_options.grid_resolution),
+         "node spacing of --backend grid in pixels")
+        ("theta", po::value(&params.backend_options.theta)
+                      ->default_value(params.backend_options.theta),
+         "opening angle of --backend barnes-hut, 0 for the exact sums")
+        ("adaptive", po::bool_switch(&params.adaptive),
+         "start the viewer with adaptive step sizes")
+        ("tolerance", po::value(&params.adaptive_tolerance)
+                          ->default_value(params.adaptive_tolerance),
+         "error per step in pixels of the adaptive step sizes")
+        ("headless", po::bool_switch(&params.headless),
+         "render the seeds from --seed to --last-seed to png files, without a window")
+        ("last-seed", po::value(&params.last_seed), "last seed to render in headless mode")
+        ("output,o", po::value(&params.output_dir)->default_value(params.output_dir),
+         "output directory for headless mode")
+        ("nice-path", po::value(&params.nice_path_seed)->default_value(params.nice_path_seed),
+         "draw the nice path with this seed in headless mode, 0 for none")
+        ("save-trajectories", po::bool_switch(&params.save_trajectories),
+         "also write the trajectories of every seed to glider_<seed>.traj in headless mode")
+        ("svg", po::bool_switch(&params.save_svg),
+         "write glider_<seed>.svg instead of pngs in headless mode")
+        ("svg-tolerance", po::value(&params.svg_tolerance)->default_value(params.svg_tolerance),
+         "how many pixels the simplified SVG paths may deviate from the trajectories")
+        ("tiled", po::bool_switch(&params.tiled),
+         "render supersampled pictures of any size in tiles, streamed to png files "
+         "if built with libpng and to ppm files otherwise, in headless mode")
+        ("scale", po::value(&params.scale)->default_value(params.scale),
+         "size of the tiled pictures relative to --width and --height")
+        ("supersample", po::value(&params.supersample)->default_value(params.supersample),
+         "samples per pixel along each axis of the tiled pictures")
+        ("tile-size", po::value(&params.tile_size)->default_value(params.tile_size),
+         "tile size in pixels of the tiled pictures")
+        ("line-width", po::value(&params.line_width)->default_value(params.line_width),
+         "line width of the tiled pictures, in pixels before scaling")
+        ("density", po::bool_switch(&params.density),
+         "count the gliders per pixel and tone map the counts, in headless mode")
+        ("tone-map", po::value(&params.tone_map)->default_value(params.tone_map),
+         "tone map of --density: log or filmic")
+        ("exposure", po::value(&params.exposure)->default_value(params.exposure),
+         "brightness of a single glider with --density")
+        ("frames", po::value(&params.frames)->default_value(params.frames),
+         "render an animation of --seed with this many frames to frame_<n>.png in "
+         "headless mode, 0 for none")
+        ("spiral-to", po::value(&params.spiral_to),
+         "spiral factor of the last frame, the same as --spiral by default")
+        ("mass-to", po::value(&params.mass_to)->default_value(params.mass_to),
+         "factor on the planet masses in the last frame")
+        ("drift", po::value(&params.drift)->default_value(params.drift),
+         "distance in pixels every planet moves over the animation")
+        ("coordinate", po::value(&params.farm_port),
+         "screen the seeds from --seed to --last-seed by their nice paths with the workers "
+         "that connect to this port, and keep the best in --output")
+        ("worker", po::value(&params.farm_worker),
+         "screen seeds for the coordinator at this host:port")
+        ("farm-chunk", po::value(&params.farm_chunk)->default_value(params.farm_chunk),
+         "seeds a coordinator hands out at a time")
+        ("top", po::value(&params.farm_top)->default_value(params.farm_top),
+         "number of seeds a coordinator keeps in its catalogue")
+        ("thumbnail-width", po::value(&params.thumbnail_width)
+                                ->default_value(params.thumbnail_width),
+         "width of the thumbnails in the catalogue")
+        ("farm-timeout", po::value(&params.farm_timeout)->default_value(params.farm_timeout),
+         "seconds a worker gets for a range of seeds before the coordinator gives up on it")
+        ("from-trajectories", po::value(&params.trajectory_dir),
+         "in headless mode, draw the seeds from the .traj files in this directory, scaled to "
+         "--width and --height, instead of integrating them")
+        ("search", po::value(&params.search)->default_value(params.search),
+         "nice path search: random, coarse, refine or sliding")
+        ("attempts", po::value(&params.nice_path_attempts)
+                         ->default_value(params.nice_path_attempts),
+         "number of starts of --search random")
+        ("screenshots", po::value(&params.screenshot_dir)->default_value(params.screenshot_dir),
+         "directory of the screenshots and SVGs that the viewer saves")
+        ("nice-path-cache", po::value(&params.nice_path_cache)
+                                ->default_value(params.nice_path_cache),
+         "file that keeps the nice paths found so far, \"\" to search them every time, "
+         "nice_paths.cache in --screenshots by default")
+        ("sampling", po::value(&params.sampling)->default_value(params.sampling),
+         "glider start positions: random or halton")
+        ("time-budget", po::value(&params.time_budget)->default_value(params.time_budget),
+         "seconds the viewer spends on adding gliders to a picture, 0 for no limit")
+        ("threads,j", po::value(&params.nr_threads)->default_value(params.nr_threads),
+         "number of threads, 0 for all cores")
+        ("trace", po::value(&params.trace_file),
+         "write a Chrome trace of the run to this file, needs a build with GLIDERS_PROFILE");
+
+    // Values that are stored first are kept
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    if (vm.count("config")) {
+        const std::string path = vm["config"].as<std::string>();
+        std::ifstream file(path);
+        if (!file) throw po::error("could not read the config file " + path);
+        po::store(po::parse_config_file(file, desc), vm);
+    }
+    if (vm.count("preset")) {
+        const std::string name = vm["preset"].as<std::string>();
+        const char* options = presetOptions(name);
+        if (!options) throw po::error("there is no preset " + name);
+        std::istringstream in(options);
+        po::store(po::parse_config_file(in, desc), vm);
+    }
+    po::notify(vm);
+
+    if (vm.count("help")) {
+        std::cout << desc << '\n';
+        return false;
+    }
+
+    if (!vm.count("last-seed")) {
+        params.last_seed = params.seed;
+    }
+
+    if (!vm.count("spiral-to")) {
+        params.spiral_to = params.spiral_factor;
+    }
+
+    if (vm["nice-path-cache"].defaulted()) {
+        params.nice_path_cache = params.screenshot_dir + "/nice_paths.cache";
+    }
+
+    if (params.width == 0 || params.height == 0 || params.nr_planets == 0 ||
+        params.max_steps == 0 || params.nice_path_attempts == 0) {
+        throw po::error("--width, --height, --planets, --steps and --attempts have to be "
+                        "positive");
+    }
+    if (params.backend_options.grid_resolution <= 0 || params.backend_options.theta < 0 ||
+        params.adaptive_tolerance <= 0) {
+        throw po::error("--grid-resolution and --tolerance have to be positive, and --theta "
+                        "can not be negative");
+    }
+
+    if (params.tiled + params.save_svg + params.density > 1) {
+        throw po::error("only one of --tiled, --svg and --density can be used");
+    }
+    if (params.scale <= 0 || params.supersample == 0 || params.tile_size == 0) {
+        throw po::error("--scale, --supersample and --tile-size have to be positive");
+    }
+
+    if (params.save_svg && params.save_trajectories) {
+        throw po::error("--svg integrates the gliders a few at a time and can not be "
+                        "combined with --save-trajectories");
+    }
+
+    if (params.frames > 0 && (params.tiled || params.save_svg || params.density ||
+                              params.save_trajectories || !params.trajectory_dir.empty())) {
+        throw po::error("--frames renders pngs and can not be combined with --tiled, --svg, "
+                        "--density, --save-trajectories or --from-trajectories");
+    }
+    if (params.farm_port != 0 && !params.farm_worker.empty()) {
+        throw po::error("a program is either a coordinator or a worker, not both");
+    }
+    if (params.farm_chunk == 0 || params.farm_top == 0 || params.thumbnail_width == 0 ||
+        params.farm_timeout == 0) {
+        throw po::error("--farm-chunk, --top, --thumbnail-width and --farm-timeout have to "
+                        "be positive");
+    }
+    if (!params.farm_worker.empty() && params.farm_worker.find(':') == std::string::npos) {
+        throw po::error("--worker needs the coordinator as host:port");
+    }
+    if (params.mass_to <= 0) {
+        throw po::error("--mass-to has to be positive");
+    }
+
+    if (!params.trace_file.empty() && !profile::enabled) {
+        std::cerr << "--trace needs a build with GLIDERS_PROFILE, the trace will be empty\n";
+    }
+
+    return true;
+}
+
+#endif // PARAMS_HPP
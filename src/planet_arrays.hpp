@@ -0,0 +1,215 @@
+#ifndef PLANET_ARRAYS_HPP
+#define PLANET_ARRAYS_HPP
+
+#include <vector>
+#include "point.hpp"
+#include "fast_math.hpp"
+#include "point_batch.hpp"
+#include "simd.hpp"
+
+// Planets stored as one array per attribute, so the field kernels can load
+// a whole vector of planets at once. The arrays are padded to
+// simd::max_width with massless planets far outside of any sensible probe
+// position, which contribute exactly zero and save us a remainder loop.
+
+struct PlanetArrays {
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> mass;
+    // Premultiplied for the fused kernel, so its loop body has no branches:
+    // mass * gravitational constant, and mass * (+1 for ccw, -1 for cw).
+    std::vector<float> g_mass;
+    std::vector<float> spin_mass;
+
+    void clear() {
+        x.clear();
+        y.clear();
+        mass.clear();
+        g_mass.clear();
+        spin_mass.clear();
+    }
+
+    void push(point const& pos, const float m, const bool ccw,
+              const float gravitational_constant) {
+        x.push_back(pos.x);
+        y.push_back(pos.y);
+        mass.push_back(m);
+        g_mass.push_back(m * gravitational_constant);
+        spin_mass.push_back(ccw ? m : -m);
+    }
+
+    void pad() {
+        const float far_away = 1e15f;
+        while (x.size() % simd::max_width != 0) {
+            x.push_back(far_away);
+            y.push_back(far_away);
+            mass.push_back(0.f);
+            g_mass.push_back(0.f);
+            spin_mass.push_back(0.f);
+        }
+    }
+
+    std::size_t size() const { return x.size(); }
+};
+
+namespace kernels {
+    using simd::vfloat;
+
+    // Sum over all planets of -m * r / |r|^3, with r = pos - planet.
+    inline point gravity(PlanetArrays const& planets, point const& pos) {
+        const vfloat px(pos.x), py(pos.y);
+        vfloat out_x(0.f), out_y(0.f);
+
+        for (std::size_t i = 0; i < planets.size(); i += vfloat::width) {
+            const vfloat rx = px - vfloat::load(&planets.x[i]);
+            const vfloat ry = py - vfloat::load(&planets.y[i]);
+            const vfloat sq = rx * rx + ry * ry;
+            const vfloat f = fastmath::overDistanceCubed(vfloat::load(&planets.mass[i]), sq);
+            out_x -= rx * f;
+            out_y -= ry * f;
+        }
+
+        return point(out_x.sum(), out_y.sum());
+    }
+
+    // Sum over all planets of -m / |r|.
+    inline float potential(PlanetArrays const& planets, point const& pos) {
+        const vfloat px(pos.x), py(pos.y);
+        vfloat out(0.f);
+
+        for (std::size_t i = 0; i < planets.size(); i += vfloat::width) {
+            const vfloat rx = px - vfloat::load(&planets.x[i]);
+            const vfloat ry = py - vfloat::load(&planets.y[i]);
+            out -= fastmath::overDistance(vfloat::load(&planets.mass[i]), rx * rx + ry * ry);
+        }
+
+        return out.sum();
+    }
+
+    // Sum over all planets of m * spin * (r.y, -r.x) / |r|^2.
+    inline point angularGradient(PlanetArrays const& planets, point const& pos) {
+        const vfloat px(pos.x), py(pos.y);
+        vfloat out_x(0.f), out_y(0.f);
+
+        for (std::size_t i = 0; i < planets.size(); i += vfloat::width) {
+            const vfloat rx = px - vfloat::load(&planets.x[i]);
+            const vfloat ry = py - vfloat::load(&planets.y[i]);
+            const vfloat f = fastmath::overDistanceSquared(vfloat::load(&planets.spin_mass[i]),
+                                                           rx * rx + ry * ry);
+            out_x += ry * f;
+            out_y -= rx * f;
+        }
+
+        return point(out_x.sum(), out_y.sum());
+    }
+
+    // Gradient of the total potential in a single sweep over the planets,
+    // the same as -G * gravity(pos) - angular_factor * angularGradient(pos)
+    // but sharing r and |r|^2 between both terms.
+    inline point totalGradient(PlanetArrays const& planets, point const& pos,
+                               const float angular_factor) {
+        const vfloat px(pos.x), py(pos.y), af(angular_factor);
+        vfloat out_x(0.f), out_y(0.f);
+
+        for (std::size_t i = 0; i < planets.size(); i += vfloat::width) {
+            const vfloat rx = px - vfloat::load(&planets.x[i]);
+            const vfloat ry = py - vfloat::load(&planets.y[i]);
+            vfloat inv_sq, inv_dist;
+            fastmath::inverseSquare(rx * rx + ry * ry, inv_sq, inv_dist);
+            const vfloat grav = vfloat::load(&planets.g_mass[i]) * inv_sq * inv_dist;
+            const vfloat ang = af * vfloat::load(&planets.spin_mass[i]) * inv_sq;
+            out_x += rx * grav - ry * ang;
+            out_y += ry * grav + rx * ang;
+        }
+
+        return point(out_x.sum(), out_y.sum());
+    }
+
+    // Both parts of totalGradient, with |r| clamped to at least the
+    // softening radius. That leaves the field untouched further away than
+    // that from every planet, and makes it smooth everywhere.
+    inline void softenedGradients(PlanetArrays const& planets, point const& pos,
+                                  const float softening_radius,
+                                  point& gravity_gradient, point& angular_gradient) {
+        const vfloat px(pos.x), py(pos.y), sq_soft(softening_radius * softening_radius);
+        vfloat grav_x(0.f), grav_y(0.f), ang_x(0.f), ang_y(0.f);
+
+        for (std::size_t i = 0; i < planets.size(); i += vfloat::width) {
+            const vfloat rx = px - vfloat::load(&planets.x[i]);
+            const vfloat ry = py - vfloat::load(&planets.y[i]);
+            vfloat inv_sq, inv_dist;
+            fastmath::inverseSquare(max(rx * rx + ry * ry, sq_soft), inv_sq, inv_dist);
+            const vfloat grav = vfloat::load(&planets.g_mass[i]) * inv_sq * inv_dist;
+            const vfloat ang = vfloat::load(&planets.spin_mass[i]) * inv_sq;
+            grav_x += rx * grav;
+            grav_y += ry * grav;
+            ang_x += ry * ang;
+            ang_y -= rx * ang;
+        }
+
+        gravity_gradient = point(grav_x.sum(), grav_y.sum());
+        angular_gradient = point(ang_x.sum(), ang_y.sum());
+    }
+
+    // totalGradient for a batch of probe positions. Here the vectors run
+    // over the probes instead of the planets, so no horizontal sums are
+    // needed and each lane's result does not depend on the other lanes.
+    inline PointBatch totalGradient(PlanetArrays const& planets, PointBatch const& pos,
+                                    const float angular_factor) {
+        static_assert(PointBatch::lanes % vfloat::width == 0,
+                      "PointBatch lanes have to fill whole vectors");
+
+        PointBatch out;
+        for (std::size_t l = 0; l < PointBatch::lanes; l += vfloat::width) {
+            const vfloat px = vfloat::load(&pos.x[l]);
+            const vfloat py = vfloat::load(&pos.y[l]);
+            const vfloat af(angular_factor);
+            vfloat out_x(0.f), out_y(0.f);
+
+            for (std::size_t i = 0; i < planets.size(); ++i) {
+                const vfloat rx = px - vfloat(planets.x[i]);
+                const vfloat ry = py - vfloat(planets.y[i]);
+                vfloat inv_sq, inv_dist;
+                fastmath::inverseSquare(rx * rx + ry * ry, inv_sq, inv_dist);
+                const vfloat grav = vfloat(planets.g_mass[i]) * inv_sq * inv_dist;
+                const vfloat ang = af * vfloat(planets.spin_mass[i]) * inv_sq;
+                out_x += rx * grav - ry * ang;
+                out_y += ry * grav + rx * ang;
+            }
+
+            out_x.store(&out.x[l]);
+            out_y.store(&out.y[l]);
+        }
+
+        return out;
+    }
+
+    // One lane of the batch totalGradient above, or of the one in
+    // exact_field.hpp without the angular term unless Angular. The planets
+    // are summed one after the other instead of a vector of them at a
+    // time, so a single glider follows exactly the path it would in a
+    // batch, which totalGradient for a point does not guarantee.
+    template <bool Angular = true, typename Planets>
+    point laneTotalGradient(Planets const& planets, point const& pos,
+                            const float angular_factor) {
+        float out_x = 0.f, out_y = 0.f;
+        for (std::size_t i = 0; i < planets.size(); ++i) {
+            const float rx = pos.x - planets.x[i];
+            const float ry = pos.y - planets.y[i];
+            float inv_sq, inv_dist;
+            fastmath::inverseSquare(rx * rx + ry * ry, inv_sq, inv_dist);
+            const float grav = planets.g_mass[i] * inv_sq * inv_dist;
+            if (Angular) {
+                const float ang = angular_factor * planets.spin_mass[i] * inv_sq;
+                out_x += rx * grav - ry * ang;
+                out_y += ry * grav + rx * ang;
+            } else {
+                out_x += rx * grav;
+                out_y += ry * grav;
+            }
+        }
+        return point(out_x, out_y);
+    }
+}
+
+#endif // PLANET_ARRAYS_HPP
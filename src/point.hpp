@@ -1,11 +1,13 @@
 #ifndef POINT_HPP
 #define POINT_HPP
 
+#include <array>
 #include <iostream>
 #include <ostream>
 #include <cmath>
 #include <tuple>
 #include <random>
+#include "fast_math.hpp"
 
 struct point {
     float x;
@@ -15,8 +17,6 @@ struct point {
 
     point(float x, float y) : x(x), y(y) {}
 
-    point(const point& o) : x(o.x), y(o.y) {}
-
     point operator+(const point& o) const { return point(x + o.x, y + o.y); }
 
     point operator-(const point& o) const { return point(x - o.x, y - o.y); }
@@ -53,8 +53,14 @@ struct point {
         return atan2(y, x);
     }
 
+    // 1 / mag(), taken with fastmath::rsqrt in fast math builds
+    float invMag() const {
+        return fastmath::rsqrt(sqmag());
+    }
+
     point norm() const {
-        return (*this) / mag();
+        if (fastmath::level == 0) return (*this) / mag();
+        return (*this) * invMag();
     }
     
 
@@ -0,0 +1,106 @@
+#ifndef POINT_BATCH_HPP
+#define POINT_BATCH_HPP
+
+#include <array>
+#include <cmath>
+#include "fast_math.hpp"
+#include "point.hpp"
+#include "simd.hpp"
+
+// A fixed number of points stored as separate x and y lanes. It supports
+// the same arithmetic as point, so the integrators can step a whole batch
+// of gliders at once, with every lane following exactly the operations a
+// single point would.
+
+struct PointBatch {
+    static constexpr std::size_t lanes = 8;
+
+    std::array<float, lanes> x;
+    std::array<float, lanes> y;
+
+    PointBatch() {
+        x.fill(0.f);
+        y.fill(0.f);
+    }
+
+    point operator[](const std::size_t lane) const { return point(x[lane], y[lane]); }
+
+    void set(const std::size_t lane, point const& p) {
+        x[lane] = p.x;
+        y[lane] = p.y;
+    }
+
+    PointBatch operator+(PointBatch const& o) const {
+        PointBatch out;
+        for (std::size_t i = 0; i < lanes; ++i) {
+            out.x[i] = x[i] + o.x[i];
+            out.y[i] = y[i] + o.y[i];
+        }
+        return out;
+    }
+
+    PointBatch operator-(PointBatch const& o) const {
+        PointBatch out;
+        for (std::size_t i = 0; i < lanes; ++i) {
+            out.x[i] = x[i] - o.x[i];
+            out.y[i] = y[i] - o.y[i];
+        }
+        return out;
+    }
+
+    inline friend PointBatch operator*(PointBatch const& p, float f) {
+        PointBatch out;
+        for (std::size_t i = 0; i < lanes; ++i) {
+            out.x[i] = p.x[i] * f;
+            out.y[i] = p.y[i] * f;
+        }
+        return out;
+    }
+
+    inline friend PointBatch operator*(float f, PointBatch const& p) {
+        return p * f;
+    }
+
+    PointBatch operator/(const float f) const {
+        PointBatch out;
+        for (std::size_t i = 0; i < lanes; ++i) {
+            out.x[i] = x[i] / f;
+            out.y[i] = y[i] / f;
+        }
+        return out;
+    }
+
+    // Per lane sqmag
+    std::array<float, lanes> sqmag() const {
+        std::array<float, lanes> out;
+        for (std::size_t i = 0; i < lanes; ++i) {
+            out[i] = x[i] * x[i] + y[i] * y[i];
+        }
+        return out;
+    }
+
+    // Per lane point::norm, in fast math builds a whole vector of lanes at
+    // a time with fastmath::rsqrt
+    PointBatch norm() const {
+        using simd::vfloat;
+        PointBatch out;
+        if (fastmath::level > 0) {
+            for (std::size_t i = 0; i < lanes; i += vfloat::width) {
+                const vfloat vx = vfloat::load(&x[i]);
+                const vfloat vy = vfloat::load(&y[i]);
+                const vfloat inv_mag = fastmath::rsqrt(vx * vx + vy * vy);
+                (vx * inv_mag).store(&out.x[i]);
+                (vy * inv_mag).store(&out.y[i]);
+            }
+            return out;
+        }
+        for (std::size_t i = 0; i < lanes; ++i) {
+            const float mag = std::sqrt(x[i] * x[i] + y[i] * y[i]);
+            out.x[i] = x[i] / mag;
+            out.y[i] = y[i] / mag;
+        }
+        return out;
+    }
+};
+
+#endif // POINT_BATCH_HPP
@@ -0,0 +1,256 @@
+#ifndef PROFILE_HPP
+#define PROFILE_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#ifdef GLIDERS_PROFILE
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#endif
+
+// Instrumentation of the hot paths, compiled in when GLIDERS_PROFILE is
+// defined. Otherwise the timers and counters are empty inline functions
+// that the compiler removes entirely.
+//
+// A ScopedTimer records when and on which thread a phase ran, counters add
+// up events like integration steps. Timers are meant for coarse phases
+// like a batch of gliders, not for single steps, as every one of them
+// takes a lock. Counters are atomic, but should still be added up locally
+// and counted once per batch.
+//
+// The recorded phases can be summed up by name, which the viewer shows in
+// its overlay, or written as a Chrome trace that chrome://tracing and
+// Perfetto can open.
+
+namespace profile {
+
+enum class Counter {
+    systems,
+    planets,
+    steps,
+    field_evaluations,
+    // Why gliders stopped before reaching the maximum number of steps
+    stopped_too_far,
+    stopped_stuck,
+    stopped_by_caller,
+    scored_points,
+    nice_path_cache_hits,
+    nr_counters
+};
+
+const std::size_t nr_counters = static_cast<std::size_t>(Counter::nr_counters);
+
+inline const char* counterName(const Counter counter) {
+    switch (counter) {
+    case Counter::systems: return "systems";
+    case Counter::planets: return "planets";
+    case Counter::steps: return "steps";
+    case Counter::field_evaluations: return "field evaluations";
+    case Counter::stopped_too_far: return "stopped, step too long";
+    case Counter::stopped_stuck: return "stopped, stuck";
+    case Counter::stopped_by_caller: return "stopped by caller";
+    case Counter::scored_points: return "scored points";
+    case Counter::nice_path_cache_hits: return "nice path cache hits";
+    case Counter::nr_counters: break;
+    }
+    return "";
+}
+
+struct PhaseSummary {
+    std::string name;
+    std::size_t calls = 0;
+    double seconds = 0;
+};
+
+// Phases by name, in order of first appearance, and the counters
+struct Summary {
+    std::vector<PhaseSummary> phases;
+    std::array<std::uint64_t, nr_counters> counters {};
+};
+
+// A point in the recording, to summarize what happened after it
+struct Mark {
+    std::size_t event = 0;
+    std::array<std::uint64_t, nr_counters> counters {};
+};
+
+inline void printSummary(std::ostream& out, Summary const& summary) {
+    for (auto const& phase : summary.phases) {
+        out << phase.name << ": " << phase.seconds * 1000 << " ms in "
+            << phase.calls << " calls\n";
+    }
+    for (std::size_t c = 0; c < nr_counters; ++c) {
+        out << counterName(static_cast<Counter>(c)) << ": " << summary.counters[c] << '\n';
+    }
+}
+
+#ifdef GLIDERS_PROFILE
+
+const bool enabled = true;
+
+namespace detail {
+
+using Clock = std::chrono::steady_clock;
+
+struct Event {
+    const char* name;
+    unsigned thread;
+    Clock::time_point start;
+    Clock::duration duration;
+};
+
+// Past this many events only the counters go on
+const std::size_t max_events = 1 << 20;
+
+struct Recorder {
+    const Clock::time_point epoch = Clock::now();
+    std::mutex mutex;
+    std::vector<Event> events;
+    std::size_t dropped = 0;
+    std::array<std::atomic<std::uint64_t>, nr_counters> counters {};
+    std::atomic<unsigned> next_thread {0};
+};
+
+inline Recorder& recorder() {
+    static Recorder r;
+    return r;
+}
+
+// Small thread ids, in the order the threads first recorded something
+inline unsigned threadIndex() {
+    thread_local const unsigned index = recorder().next_thread++;
+    return index;
+}
+
+} // namespace detail
+
+class ScopedTimer {
+    const char* name;
+    detail::Clock::time_point start;
+
+public:
+    // name must outlive the recording, i.e. be a string literal
+    explicit ScopedTimer(const char* name) : name(name), start(detail::Clock::now()) {}
+
+    ScopedTimer(ScopedTimer const&) = delete;
+    ScopedTimer& operator=(ScopedTimer const&) = delete;
+
+    ~ScopedTimer() {
+        const auto end = detail::Clock::now();
+        const unsigned thread = detail::threadIndex();
+        auto& r = detail::recorder();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        if (r.events.size() < detail::max_events) {
+            r.events.push_back({name, thread, start, end - start});
+        } else {
+            ++r.dropped;
+        }
+    }
+};
+
+inline void count(const Counter counter, const std::uint64_t n = 1) {
+    detail::recorder().counters[static_cast<std::size_t>(counter)].fetch_add(
+        n, std::memory_order_relaxed);
+}
+
+inline Mark mark() {
+    auto& r = detail::recorder();
+    Mark m;
+    {
+        std::lock_guard<std::mutex> lock(r.mutex);
+        m.event = r.events.size();
+    }
+    for (std::size_t c = 0; c < nr_counters; ++c) {
+        m.counters[c] = r.counters[c].load(std::memory_order_relaxed);
+    }
+    return m;
+}
+
+// Everything recorded after since, all of it by default
+inline Summary summarize(Mark const& since = Mark()) {
+    auto& r = detail::recorder();
+    Summary summary;
+    std::map<const char*, std::size_t> index;
+    {
+        std::lock_guard<std::mutex> lock(r.mutex);
+        for (std::size_t i = since.event; i < r.events.size(); ++i) {
+            detail::Event const& e = r.events[i];
+            auto found = index.find(e.name);
+            if (found == index.end()) {
+                found = index.emplace(e.name, summary.phases.size()).first;
+                summary.phases.push_back({e.name});
+            }
+            PhaseSummary& phase = summary.phases[found->second];
+            ++phase.calls;
+            phase.seconds += std::chrono::duration<double>(e.duration).count();
+        }
+    }
+    for (std::size_t c = 0; c < nr_counters; ++c) {
+        summary.counters[c] = r.counters[c].load(std::memory_order_relaxed) - since.counters[c];
+    }
+    return summary;
+}
+
+// All events so far in the Chrome trace event format, as complete events
+// with microsecond times, and the counters in otherData.
+inline void writeChromeTrace(std::ostream& out) {
+    auto& r = detail::recorder();
+    auto micros = [](detail::Clock::duration d) {
+        return std::chrono::duration<double, std::micro>(d).count();
+    };
+
+    std::lock_guard<std::mutex> lock(r.mutex);
+    out << "{\"traceEvents\":[";
+    for (std::size_t i = 0; i < r.events.size(); ++i) {
+        detail::Event const& e = r.events[i];
+        out << (i ? ",\n" : "\n")
+            << "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << e.thread
+            << ",\"ts\":" << micros(e.start - r.epoch) << ",\"dur\":" << micros(e.duration) << '}';
+    }
+    out << "\n],\"otherData\":{\"dropped events\":" << r.dropped;
+    for (std::size_t c = 0; c < nr_counters; ++c) {
+        out << ",\"" << counterName(static_cast<Counter>(c)) << "\":"
+            << r.counters[c].load(std::memory_order_relaxed);
+    }
+    out << "}}\n";
+}
+
+#else
+
+const bool enabled = false;
+
+class ScopedTimer {
+public:
+    explicit ScopedTimer(const char*) {}
+};
+
+inline void count(Counter, std::uint64_t = 1) {}
+
+inline Mark mark() { return {}; }
+
+inline Summary summarize(Mark const& = Mark()) { return {}; }
+
+inline void writeChromeTrace(std::ostream& out) {
+    out << "{\"traceEvents\":[]}\n";
+}
+
+#endif // GLIDERS_PROFILE
+
+// Writes the Chrome trace to path, returns false if that failed
+inline bool writeChromeTrace(std::string const& path) {
+    std::ofstream out(path);
+    writeChromeTrace(out);
+    return static_cast<bool>(out);
+}
+
+} // namespace profile
+
+#endif // PROFILE_HPP
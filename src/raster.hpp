@@ -0,0 +1,196 @@
+#ifndef RASTER_HPP
+#define RASTER_HPP
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "point.hpp"
+#include "trajectory_pool.hpp"
+
+// Software rasterizer for rendering without an OpenGL context. Colours are
+// kept as floats, so many faint, alpha blended trajectories add up without
+// 8 bit rounding at every step. Lines are antialiased with Xiaolin Wu's
+// algorithm.
+
+struct Rgba {
+    float r, g, b, a; // all in [0, 1]
+
+    static Rgba fromBytes(const std::uint8_t r, const std::uint8_t g,
+                          const std::uint8_t b, const std::uint8_t a = 255) {
+        return {r / 255.f, g / 255.f, b / 255.f, a / 255.f};
+    }
+};
+
+// Calls plot(x, y, coverage) for the pixels of the antialiased line from a
+// to b on a width x height raster, with Xiaolin Wu's algorithm. Pixels
+// just outside of the raster can be plotted too.
+template <typename Plot>
+void rasterizeLine(point a, point b, const unsigned width, const unsigned height, Plot&& plot) {
+    if (!(std::isfinite(a.x) && std::isfinite(a.y) &&
+          std::isfinite(b.x) && std::isfinite(b.y))) {
+        return;
+    }
+
+    const bool steep = std::fabs(b.y - a.y) > std::fabs(b.x - a.x);
+    if (steep) {
+        std::swap(a.x, a.y);
+        std::swap(b.x, b.y);
+    }
+    if (a.x > b.x) std::swap(a, b);
+
+    auto plotMajor = [&](const int major, const int minor, const float coverage) {
+        if (steep) {
+            plot(minor, major, coverage);
+        } else {
+            plot(major, minor, coverage);
+        }
+    };
+
+    const float dx = b.x - a.x;
+    if (dx <= 0) return;
+    const float gradient = (b.y - a.y) / dx;
+
+    // Pixel (x, y) covers [x, x+1) x [y, y+1), like the window's
+    // coordinates. Lines far outside of the raster don't need a loop.
+    const int limit = steep ? height : width;
+    const int first = std::max(std::floor(a.x), 0.f);
+    const int last = std::min(std::floor(b.x), limit - 1.f);
+
+    for (int x = first; x <= last; ++x) {
+        const float left = std::max(a.x, static_cast<float>(x));
+        const float right = std::min(b.x, x + 1.f);
+        const float span = right - left;
+        if (span <= 0) continue;
+
+        const float y = a.y + gradient * ((left + right) / 2 - a.x) - 0.5f;
+        const float fy = std::floor(y);
+        const float frac = y - fy;
+        if (fy < -1 || fy > static_cast<float>(steep ? width : height)) continue;
+        plotMajor(x, static_cast<int>(fy), span * (1 - frac));
+        plotMajor(x, static_cast<int>(fy) + 1, span * frac);
+    }
+}
+
+class Canvas {
+    unsigned width_, height_;
+    std::vector<float> pixels; // rgb
+
+public:
+    Canvas(const unsigned width, const unsigned height, Rgba const& background)
+        : width_(width), height_(height), pixels(3 * static_cast<std::size_t>(width) * height) {
+        for (std::size_t i = 0; i < pixels.size(); i += 3) {
+            pixels[i] = background.r;
+            pixels[i + 1] = background.g;
+            pixels[i + 2] = background.b;
+        }
+    }
+
+    unsigned width() const { return width_; }
+    unsigned height() const { return height_; }
+
+    // Fills the canvas with background again, without reallocating
+    void clear(Rgba const& background) {
+        for (std::size_t i = 0; i < pixels.size(); i += 3) {
+            pixels[i] = background.r;
+            pixels[i + 1] = background.g;
+            pixels[i + 2] = background.b;
+        }
+    }
+
+    // The rgb floats of pixel (x, y)
+    const float* pixel(const unsigned x, const unsigned y) const {
+        return &pixels[3 * (static_cast<std::size_t>(y) * width_ + x)];
+    }
+
+    // Blends colour over pixel (x, y) with its alpha scaled by coverage.
+    void blend(const int x, const int y, Rgba const& colour, const float coverage) {
+        if (x < 0 || y < 0 || x >= static_cast<int>(width_) || y >= static_cast<int>(height_)) {
+            return;
+        }
+        const float a = colour.a * coverage;
+        float* p = &pixels[3 * (static_cast<std::size_t>(y) * width_ + x)];
+        p[0] += (colour.r - p[0]) * a;
+        p[1] += (colour.g - p[1]) * a;
+        p[2] += (colour.b - p[2]) * a;
+    }
+
+    void drawLine(point const& a, point const& b, Rgba const& colour) {
+        rasterizeLine(a, b, width_, height_, [&](const int x, const int y, const float coverage) {
+            blend(x, y, colour, coverage);
+        });
+    }
+
+    // A line width pixels wide, without caps, covering the pixels whose
+    // centres lie inside of it. It is not antialiased, so it is meant for
+    // canvases that are scaled down afterwards, and each pixel is only
+    // blended once, however wide the line.
+    void drawWideLine(point const& a, point const& b, Rgba const& colour, const float width) {
+        if (!(std::isfinite(a.x) && std::isfinite(a.y) &&
+              std::isfinite(b.x) && std::isfinite(b.y))) {
+            return;
+        }
+        const point d = b - a;
+        const float len = d.mag();
+        if (len <= 0) return;
+
+        const point n = point(-d.y, d.x) * (width / 2 / len);
+        const std::array<point, 4> quad {{a + n, b + n, b - n, a - n}};
+
+        float min_y = quad[0].y, max_y = quad[0].y;
+        for (point const& p : quad) {
+            min_y = std::min(min_y, p.y);
+            max_y = std::max(max_y, p.y);
+        }
+        // Clamped before the conversion, the line can be far off the canvas
+        auto clamp = [](const float v, const float limit) {
+            return static_cast<int>(std::min(limit, std::max(-1.f, v)));
+        };
+        const int first_row = clamp(std::ceil(min_y - 0.5f), height_);
+        const int last_row = clamp(std::floor(max_y - 0.5f), height_ - 1.f);
+
+        for (int y = std::max(0, first_row); y <= last_row; ++y) {
+            const float yc = y + 0.5f;
+            float left = std::numeric_limits<float>::max();
+            float right = std::numeric_limits<float>::lowest();
+            for (std::size_t e = 0; e < quad.size(); ++e) {
+                point const& p = quad[e];
+                point const& q = quad[(e + 1) % quad.size()];
+                if ((p.y <= yc) == (q.y <= yc)) continue;
+                const float x = p.x + (yc - p.y) * (q.x - p.x) / (q.y - p.y);
+                left = std::min(left, x);
+                right = std::max(right, x);
+            }
+            if (left > right) continue;
+
+            const int first = std::max(0, clamp(std::ceil(left - 0.5f), width_));
+            const int last = clamp(std::floor(right - 0.5f), width_ - 1.f);
+            for (int x = first; x <= last; ++x) {
+                blend(x, y, colour, 1.f);
+            }
+        }
+    }
+
+    void drawPolyline(PointSpan points, Rgba const& colour) {
+        for (std::size_t i = 1; i < points.size(); ++i) {
+            drawLine(points[i - 1], points[i], colour);
+        }
+    }
+
+    // 8 bit RGBA, rows top to bottom
+    std::vector<std::uint8_t> toRgba8() const {
+        std::vector<std::uint8_t> out(4 * static_cast<std::size_t>(width_) * height_);
+        for (std::size_t i = 0, j = 0; i < pixels.size(); i += 3, j += 4) {
+            for (int c = 0; c < 3; ++c) {
+                const float v = std::min(1.f, std::max(0.f, pixels[i + c]));
+                out[j + c] = static_cast<std::uint8_t>(v * 255.f + 0.5f);
+            }
+            out[j + 3] = 255;
+        }
+        return out;
+    }
+};
+
+#endif // RASTER_HPP
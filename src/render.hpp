@@ -0,0 +1,216 @@
+#ifndef RENDER_HPP
+#define RENDER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <SFML/Graphics.hpp>
+#include "parallel.hpp"
+#include "point.hpp"
+#include "system.hpp"
+#include "trajectory_pool.hpp"
+
+// Collects many trajectories into one vertex array, so they can be drawn
+// with a single draw call. The storage is kept between redraws and only
+// grows, so after the first frame a redraw does not allocate.
+
+class TrajectoryBatch {
+    std::vector<sf::Vertex> vertices;
+    sf::VertexBuffer buffer {sf::Lines, sf::VertexBuffer::Stream};
+    std::size_t buffer_size = 0;
+    bool uploaded = false;
+
+public:
+    void clear() {
+        vertices.clear();
+        uploaded = false;
+    }
+
+    // Adds the path as separate line segments, so that trajectories don't
+    // get connected to each other.
+    void add(PointSpan points, sf::Color const& color) {
+        for (std::size_t i = 1; i < points.size(); ++i) {
+            vertices.emplace_back(sf::Vector2f(points[i - 1].x, points[i - 1].y), color);
+            vertices.emplace_back(sf::Vector2f(points[i].x, points[i].y), color);
+        }
+        uploaded = false;
+    }
+
+    std::size_t size() const { return vertices.size(); }
+
+    void draw(sf::RenderTarget& target) {
+        if (vertices.empty()) return;
+
+        if (!sf::VertexBuffer::isAvailable()) {
+            target.draw(vertices.data(), vertices.size(), sf::Lines);
+            return;
+        }
+
+        if (!uploaded) {
+            if (vertices.size() > buffer_size) {
+                buffer_size = vertices.capacity();
+                buffer.create(buffer_size);
+            }
+            buffer.update(vertices.data(), vertices.size(), 0);
+            uploaded = true;
+        }
+
+        target.draw(buffer, 0, vertices.size());
+    }
+};
+
+// Grey level of the potential plot for a potential value, bands that
+// repeat every 1/200th of the normalized potential.
+inline sf::Uint8 potentialBand(const float potential) {
+    const float normalized_potential = -potential / 100.f;
+    return 255.f * fmod(200.0 * normalized_potential, 1.0);
+}
+
+// Draws the banded potential of a system over the whole target as a single
+// textured quad. On the GPU, a fragment shader evaluates the potential of
+// every pixel. Its planet array is sized for the system, rounded up to a
+// power of two so that only a few shaders are ever compiled, as a fixed
+// large one would not link on GPUs with few uniforms. Without shader
+// support, or with more planets than the GPU takes, the potential is
+// computed on the CPU in tiles of cpu_tile pixels, in parallel over the
+// rows, and uploaded as a texture. That takes a while, so a caller that
+// must not block can compute the pixels on another thread and only draw
+// them with drawPixels.
+
+class PotentialPlot {
+    static const std::size_t min_shader_planets = 16;
+    static const unsigned cpu_tile = 2;
+
+    bool shaders_available = false;
+    // By the size of their planet array, null where it did not compile
+    std::map<std::size_t, std::unique_ptr<sf::Shader>> shaders;
+
+    std::vector<sf::Uint8> pixels;
+    sf::Texture texture;
+
+    // Same as potentialBand(system.probePotential(p)) per pixel. Pixel
+    // centres are at + 0.5 in both SFML and gl_FragCoord, but the y axis
+    // is flipped.
+    static std::string shaderSource(const std::size_t max_planets) {
+        return "#version 120\n"
+            "const int max_planets = " + std::to_string(max_planets) + ";\n" + R"glsl(
+            uniform vec3 planets[max_planets];
+            uniform int nr_planets;
+            uniform float gravitational_constant;
+            uniform float height;
+
+            void main() {
+                vec2 pos = vec2(gl_FragCoord.x, height - gl_FragCoord.y);
+                float potential = 0.0;
+                for (int i = 0; i < max_planets; ++i) {
+                    if (i >= nr_planets) break;
+                    potential -= planets[i].z / length(pos - planets[i].xy);
+                }
+                potential *= gravitational_constant;
+
+                float value = fract(200.0 * (-potential / 100.0));
+                gl_FragColor = vec4(value, value, value, 1.0);
+            }
+        )glsl";
+    }
+
+    // The shader for nr_planets, compiled on first use, or null
+    sf::Shader* shaderFor(const std::size_t nr_planets) {
+        if (!shaders_available) return nullptr;
+        std::size_t size = min_shader_planets;
+        while (size < nr_planets) size *= 2;
+
+        auto found = shaders.find(size);
+        if (found == shaders.end()) {
+            std::unique_ptr<sf::Shader> shader(new sf::Shader);
+            if (!shader->loadFromMemory(shaderSource(size), sf::Shader::Fragment)) {
+                std::cerr << "the potential shader for " << size << " planets does not "
+                          << "compile, plotting it on the CPU\n";
+                shader.reset();
+            }
+            found = shaders.emplace(size, std::move(shader)).first;
+        }
+        return found->second.get();
+    }
+
+    bool drawWithShader(sf::RenderTarget& target, System const& system) {
+        sf::Shader* shader = shaderFor(system.planets().size());
+        if (!shader) return false;
+
+        std::vector<sf::Glsl::Vec3> planets;
+        for (auto const& p : system.planets()) {
+            planets.emplace_back(p.pos.x, p.pos.y, p.mass);
+        }
+        shader->setUniformArray("planets", planets.data(), planets.size());
+        shader->setUniform("nr_planets", static_cast<int>(planets.size()));
+        shader->setUniform("gravitational_constant", system.gravitationalConstant());
+        shader->setUniform("height", static_cast<float>(target.getSize().y));
+
+        const sf::Vector2u size = target.getSize();
+        sf::RectangleShape quad(sf::Vector2f(size.x, size.y));
+        target.draw(quad, shader);
+        return true;
+    }
+
+public:
+    PotentialPlot() : shaders_available(sf::Shader::isAvailable()) {}
+
+    // Whether draw runs on the GPU for system, instead of computing the pixels
+    bool drawsWithShader(System const& system) {
+        return shaderFor(system.planets().size()) != nullptr;
+    }
+
+    // The RGBA pixels of the plot, row by row, with the potential taken at
+    // the centre of every tile. Only reads system, so it can run on any
+    // thread. Rows that are not started yet once cancelled is set are left
+    // black.
+    static void computePixels(System const& system, const unsigned width, const unsigned height,
+                              std::vector<sf::Uint8>& pixels, const unsigned nr_threads = 0,
+                              std::atomic<bool> const* cancelled = nullptr) {
+        pixels.assign(4 * static_cast<std::size_t>(width) * height, 0);
+        const std::size_t nr_tile_rows = (height + cpu_tile - 1) / cpu_tile;
+
+        parallel::forEach(nr_tile_rows, [&](unsigned, const std::size_t tile_row) {
+            if (cancelled && *cancelled) return;
+            const std::size_t y0 = tile_row * cpu_tile;
+            const std::size_t y1 = std::min<std::size_t>(height, y0 + cpu_tile);
+            for (unsigned x0 = 0; x0 < width; x0 += cpu_tile) {
+                const point p (x0 + 0.5f * cpu_tile, y0 + 0.5f * cpu_tile);
+                const sf::Uint8 value = potentialBand(system.probePotential(p));
+                const unsigned x1 = std::min(width, x0 + cpu_tile);
+                for (std::size_t y = y0; y < y1; ++y) {
+                    sf::Uint8* row = &pixels[4 * y * width];
+                    for (unsigned x = x0; x < x1; ++x) {
+                        row[4 * x] = row[4 * x + 1] = row[4 * x + 2] = value;
+                        row[4 * x + 3] = 255;
+                    }
+                }
+            }
+        }, nr_threads);
+    }
+
+    // Draws pixels from computePixels, which have the size of target
+    void drawPixels(sf::RenderTarget& target, std::vector<sf::Uint8> const& pixels) {
+        const sf::Vector2u size = target.getSize();
+        if (texture.getSize().x != size.x || texture.getSize().y != size.y) {
+            texture.create(size.x, size.y);
+        }
+        texture.update(pixels.data());
+        target.draw(sf::Sprite(texture));
+    }
+
+    void draw(sf::RenderTarget& target, System const& system, const unsigned nr_threads = 0) {
+        if (drawWithShader(target, system)) return;
+
+        const sf::Vector2u size = target.getSize();
+        computePixels(system, size.x, size.y, pixels, nr_threads);
+        drawPixels(target, pixels);
+    }
+};
+
+#endif // RENDER_HPP
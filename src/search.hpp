@@ -0,0 +1,229 @@
+#ifndef SEARCH_HPP
+#define SEARCH_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+#include "glider.hpp"
+#include "search_strategy.hpp"
+#include "trajectory_pool.hpp"
+
+// Search strategies for the nice path that spend fewer integration steps
+// than trying 1000 random starts in full. All of them are deterministic
+// for a given seed, no matter the number of threads.
+//
+//  - coarse_to_fine scores many random starts on short paths and only
+//    integrates the most promising ones in full. It misses paths that
+//    only get good late.
+//  - refine starts from a few random candidates and then tries random
+//    perturbations of the best ones, shrinking the perturbations as it
+//    goes. It finds the best of a good region, but only of the regions
+//    its first candidates landed in.
+//  - sliding integrates a few long paths, and scores every window of
+//    max_steps steps along them as a candidate. A window starting at
+//    point k is exactly the path of a glider starting there, as the
+//    gliders follow a fixed field, so its score comes without integrating.
+//    The cheapest per candidate, but the candidates all lie on a few
+//    trajectories.
+//
+// Their default budgets integrate a fraction of the steps of the random
+// search, at the price of sometimes settling for a lower scoring path.
+//
+// warmStartSearch is not a strategy of its own but continues from the
+// nice path of a similar system, see there.
+
+// Candidates in the order of decreasing score, the higher index first on
+// ties, like bestCandidate.
+inline std::vector<std::size_t> rankCandidates(std::vector<float> const& scores) {
+    std::vector<std::size_t> order(scores.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](const std::size_t a, const std::size_t b) {
+        return scores[a] > scores[b] || (scores[a] == scores[b] && a > b);
+    });
+    return order;
+}
+
+template <typename Field>
+NicePath coarseToFineSearch(CandidateEvaluator<Field>& evaluator,
+                            const std::size_t max_steps, const int seed,
+                            const std::size_t attempts = 1000,
+                            const std::size_t coarse_steps = 20,
+                            const std::size_t top_k = 100) {
+    const auto starts = randomCandidates(attempts, seed, evaluator.searchBounds());
+    const auto coarse_scores = evaluator.score(starts, std::min(coarse_steps, max_steps));
+
+    const auto order = rankCandidates(coarse_scores);
+    std::vector<GliderStart> finalists;
+    for (std::size_t i = 0; i < std::min(top_k, order.size()); ++i) {
+        finalists.push_back(starts[order[i]]);
+    }
+
+    const auto scores = evaluator.score(finalists, max_steps, true);
+    const std::size_t best = bestCandidate(scores);
+    return {finalists[best].pos, finalists[best].ccw, scores[best]};
+}
+
+namespace detail {
+    // Rounds of random perturbations of the elite best of starts, with the
+    // radius halved every round. The children of round r get the rng
+    // streams from first_index + r * per_round on, and are appended to
+    // starts and scores.
+    template <typename Field>
+    void perturbCandidates(CandidateEvaluator<Field>& evaluator,
+                           const std::size_t max_steps, const int seed,
+                           std::vector<GliderStart>& starts, std::vector<float>& scores,
+                           const std::size_t first_index, const std::size_t rounds,
+                           const std::size_t per_round, const std::size_t elite,
+                           float radius) {
+        auto const& bounds = evaluator.searchBounds();
+
+        for (std::size_t round = 0; round < rounds; ++round) {
+            const auto order = rankCandidates(scores);
+            const std::size_t nr_parents = std::min(elite, order.size());
+
+            std::vector<GliderStart> children(per_round);
+            for (std::size_t i = 0; i < per_round; ++i) {
+                auto rng = candidateRng(seed, first_index + round * per_round + i);
+                std::normal_distribution<float> offset(0.f, radius);
+                GliderStart const& parent = starts[order[i % nr_parents]];
+                children[i].ccw = parent.ccw;
+                children[i].pos = parent.pos + point(offset(rng), offset(rng));
+                children[i].pos.x = std::min(bounds[1].x, std::max(bounds[0].x, children[i].pos.x));
+                children[i].pos.y = std::min(bounds[1].y, std::max(bounds[0].y, children[i].pos.y));
+            }
+
+            const auto child_scores = evaluator.score(children, max_steps);
+            starts.insert(starts.end(), children.begin(), children.end());
+            scores.insert(scores.end(), child_scores.begin(), child_scores.end());
+
+            radius /= 2;
+        }
+    }
+}
+
+template <typename Field>
+NicePath refineSearch(CandidateEvaluator<Field>& evaluator,
+                      const std::size_t max_steps, const int seed,
+                      const std::size_t initial = 96,
+                      const std::size_t rounds = 4,
+                      const std::size_t per_round = 24,
+                      const std::size_t elite = 8,
+                      const float initial_radius = 150.f) {
+    std::vector<GliderStart> starts = randomCandidates(initial, seed, evaluator.searchBounds());
+    std::vector<float> scores = evaluator.score(starts, max_steps);
+
+    // The perturbations get indices past the initial candidates
+    detail::perturbCandidates(evaluator, max_steps, seed, starts, scores, initial,
+                              rounds, per_round, elite, initial_radius);
+
+    const std::size_t best = bestCandidate(scores);
+    return {starts[best].pos, starts[best].ccw, scores[best]};
+}
+
+// For a system that is only slightly different from one whose nice path
+// started at previous, like the next frame of an animation: the nice path
+// usually moves only a little, so this scores previous with a few fresh
+// random starts, in case a better one appeared elsewhere, and then
+// perturbs the best of them in small steps. Costs about two thirds of a
+// refine search, and keeps the path from jumping between frames as long as it
+// stays good.
+template <typename Field>
+NicePath warmStartSearch(CandidateEvaluator<Field>& evaluator,
+                         const std::size_t max_steps, const int seed,
+                         GliderStart const& previous,
+                         const std::size_t fresh = 32,
+                         const std::size_t rounds = 3,
+                         const std::size_t per_round = 32,
+                         const std::size_t elite = 4,
+                         const float initial_radius = 40.f) {
+    // previous takes index 0, the fresh ones 1 to fresh
+    std::vector<GliderStart> starts {previous};
+    const auto others = randomCandidates(fresh, seed, evaluator.searchBounds(), 1);
+    starts.insert(starts.end(), others.begin(), others.end());
+    std::vector<float> scores = evaluator.score(starts, max_steps);
+
+    detail::perturbCandidates(evaluator, max_steps, seed, starts, scores, fresh + 1,
+                              rounds, per_round, elite, initial_radius);
+
+    const std::size_t best = bestCandidate(scores);
+    return {starts[best].pos, starts[best].ccw, scores[best]};
+}
+
+template <typename Field>
+NicePath slidingSearch(CandidateEvaluator<Field>& evaluator,
+                       const std::size_t max_steps, const int seed,
+                       const std::size_t nr_paths = 64,
+                       const std::size_t extension = 400,
+                       const std::size_t stride = 2) {
+    auto const& bounds = evaluator.searchBounds();
+    const auto starts = randomCandidates(nr_paths, seed, bounds);
+
+    TrajectoryPool pool;
+    evaluator.trajectories(starts, max_steps + extension, pool);
+
+    // Windows of every path in order, so the tie breaking is the same for
+    // any number of threads
+    struct Window {
+        std::size_t path, offset;
+    };
+    std::vector<Window> windows;
+    for (std::size_t i = 0; i < pool.size(); ++i) {
+        for (std::size_t k = 0; k <= extension && k < pool[i].size(); k += stride) {
+            windows.push_back({i, k});
+        }
+    }
+
+    std::vector<float> scores(windows.size());
+    parallel::forEach(windows.size(), [&](unsigned, const std::size_t w) {
+        const PointSpan path = pool[windows[w].path];
+        const std::size_t offset = windows[w].offset;
+        const std::size_t length = std::min(max_steps + 1, path.size() - offset);
+        scores[w] = scorePath(evaluator.planetIndex(), bounds,
+                              PointSpan(path.data() + offset, length));
+    }, evaluator.threads(), 16);
+
+    const std::size_t best = bestCandidate(scores);
+    Window const& window = windows[best];
+    return {pool[window.path][window.offset], starts[window.path].ccw, scores[best]};
+}
+
+// findNicePath with the given search strategy. attempts is the number of
+// starts of the random one, the others have their own budgets. Gives up
+// early once cancelled is set, see CandidateEvaluator.
+template <typename Field>
+NicePath findNicePath(System const& system, Field const& field,
+                      const float spiral_factor, const std::size_t max_steps,
+                      std::array<point,2> const& bounds, const int seed,
+                      const SearchStrategy strategy,
+                      const unsigned nr_threads = 0, const std::size_t attempts = 1000,
+                      std::atomic<bool> const* cancelled = nullptr) {
+    if (strategy == SearchStrategy::random) {
+        return findNicePath(system, field, spiral_factor, max_steps, bounds, seed, nr_threads,
+                            attempts, cancelled);
+    }
+
+    profile::ScopedTimer timer ("find nice path");
+    CandidateEvaluator<Field> evaluator (system, field, bounds, spiral_factor, nr_threads,
+                                         cancelled);
+
+    NicePath path;
+    switch (strategy) {
+    case SearchStrategy::coarse_to_fine:
+        path = coarseToFineSearch(evaluator, max_steps, seed);
+        break;
+    case SearchStrategy::refine:
+        path = refineSearch(evaluator, max_steps, seed);
+        break;
+    default:
+        path = slidingSearch(evaluator, max_steps, seed);
+        break;
+    }
+
+    return path;
+}
+
+#endif // SEARCH_HPP
@@ -0,0 +1,33 @@
+#ifndef SEARCH_STRATEGY_HPP
+#define SEARCH_STRATEGY_HPP
+
+#include <iostream>
+#include <string>
+
+// The nice path searches of search.hpp, on their own so that the
+// parameters can name one without pulling in the searches.
+
+enum class SearchStrategy { random, coarse_to_fine, refine, sliding };
+
+inline std::istream& operator>>(std::istream& in, SearchStrategy& strategy) {
+    std::string name;
+    in >> name;
+    if (name == "random") strategy = SearchStrategy::random;
+    else if (name == "coarse") strategy = SearchStrategy::coarse_to_fine;
+    else if (name == "refine") strategy = SearchStrategy::refine;
+    else if (name == "sliding") strategy = SearchStrategy::sliding;
+    else in.setstate(std::ios::failbit);
+    return in;
+}
+
+inline std::ostream& operator<<(std::ostream& out, const SearchStrategy strategy) {
+    switch (strategy) {
+    case SearchStrategy::random: return out << "random";
+    case SearchStrategy::coarse_to_fine: return out << "coarse";
+    case SearchStrategy::refine: return out << "refine";
+    case SearchStrategy::sliding: return out << "sliding";
+    }
+    return out;
+}
+
+#endif // SEARCH_STRATEGY_HPP
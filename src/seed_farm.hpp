@@ -0,0 +1,538 @@
+#ifndef SEED_FARM_HPP
+#define SEED_FARM_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/filesystem.hpp>
+#include <SFML/Graphics.hpp>
+
+#include "headless.hpp"
+#include "params.hpp"
+#include "parallel.hpp"
+
+// Screens the seeds [params.seed, params.last_seed] for good compositions
+// on any number of machines. A coordinator cuts the seeds into ranges of
+// params.farm_chunk and hands them out to the workers that connect to it.
+// Workers score every seed of a range by its nice path, and send back the
+// scores and a thumbnail of those that can still make it into the top
+// params.farm_top. The coordinator keeps that catalogue in
+// params.output_dir.
+//
+// Everything the coordinator learns goes to a journal in the output
+// directory before it is acted on, so a coordinator that is started again
+// after a crash picks up where it left off, and only the ranges that were
+// out with workers at that time are screened again.
+//
+// The protocol is lines of text over TCP, with the thumbnails as raw bytes:
+//
+//   coordinator: gliders-farm <version>
+//                params <the parameters of the pictures, see paramsLine>
+//   coordinator: range <first seed> <last seed> <lowest score that counts>
+//   worker:      result <seed> <score> <width> <height>, then the rgba8 pixels
+//                ... one for every seed that scored at least that
+//   worker:      finished
+//   ... and so on, until the coordinator sends done instead of a range.
+
+namespace farm {
+
+const int protocol_version = 2;
+
+// The parameters that decide what a seed looks like, which the workers
+// take from the coordinator
+inline std::string paramsLine(Params const& params) {
+    std::ostringstream line;
+    line << std::setprecision(std::numeric_limits<float>::max_digits10)
+         << params.width << ' ' << params.height << ' ' << params.nr_planets << ' '
+         << params.nr_gliders << ' ' << params.max_steps << ' ' << params.spiral_factor << ' '
+         << params.step_method << ' ' << params.nice_path_seed << ' ' << params.search << ' '
+         << params.sampling << ' ' << params.thumbnail_width << ' '
+         << params.nice_path_attempts << ' ' << params.backend << ' '
+         << params.backend_options.grid_resolution << ' ' << params.backend_options.theta;
+    return line.str();
+}
+
+inline bool readParamsLine(std::string const& line, Params& params) {
+    std::istringstream in(line);
+    in >> params.width >> params.height >> params.nr_planets >> params.nr_gliders
+       >> params.max_steps >> params.spiral_factor >> params.step_method
+       >> params.nice_path_seed >> params.search >> params.sampling >> params.thumbnail_width
+       >> params.nice_path_attempts >> params.backend >> params.backend_options.grid_resolution
+       >> params.backend_options.theta;
+    return static_cast<bool>(in);
+}
+
+// Seeds are ranked by score, and the lower seed first on ties
+struct Entry {
+    float score;
+    int seed;
+
+    bool operator<(Entry const& other) const {
+        return score > other.score || (score == other.score && seed < other.seed);
+    }
+};
+
+struct SeedResult {
+    Entry entry;
+    // rgba8, empty for seeds that could not make it into the catalogue
+    unsigned width = 0, height = 0;
+    std::vector<std::uint8_t> thumbnail;
+};
+
+// Size of the thumbnails for params, the same for every seed
+inline void thumbnailSize(Params const& params, unsigned& width, unsigned& height) {
+    width = std::max(1u, params.thumbnail_width);
+    height = std::max(1u, params.height * width / std::max(1u, params.width));
+}
+
+// The nice path search of the seed ranks it. Only when the score is at
+// least min_score are the gliders integrated for the thumbnail, which is
+// the same picture as drawSeed at params.thumbnail_width.
+inline SeedResult screenSeed(Params const& params, const int seed, const float min_score) {
+    profile::ScopedTimer timer ("screen seed");
+    const auto bounds = imageBounds(params);
+
+    std::mt19937 rng(seed);
+    const System system(params.nr_planets, bounds, rng);
+    const int nice_path_seed = params.nice_path_seed ? params.nice_path_seed : 1;
+    const NicePath nice_path = findNicePath(system, system, params.spiral_factor,
+                                            params.max_steps, bounds, nice_path_seed,
+                                            params.search, 1, params.nice_path_attempts);
+
+    SeedResult result;
+    result.entry = {nice_path.score, seed};
+    if (nice_path.score < min_score) return result;
+
+    TrajectoryPool gliders;
+    integrateGliders(params, system, seed, gliders);
+
+    thumbnailSize(params, result.width, result.height);
+    const float scale = static_cast<float>(result.width) / std::max(1u, params.width);
+    Canvas canvas(result.width, result.height, backgroundColour());
+    std::vector<point> points;
+    auto draw = [&](PointSpan path, Rgba const& colour) {
+        points.assign(path.begin(), path.end());
+        for (point& p : points) p *= scale;
+        canvas.drawPolyline(points, colour);
+    };
+    for (std::size_t i = 0; i < gliders.size(); ++i) draw(gliders[i], gliderColour());
+    draw(generateGliderTrajectory(nice_path.start, system, params.spiral_factor,
+                                  params.max_steps, nice_path.ccw),
+         nicePathColour());
+
+    result.thumbnail = canvas.toRgba8();
+    return result;
+}
+
+// The best params.farm_top seeds so far, with their thumbnails in dir
+class Catalogue {
+    std::string dir;
+    std::size_t size;
+    std::vector<Entry> entries;
+
+public:
+    Catalogue(std::string const& dir, const std::size_t size)
+        : dir(dir), size(std::max<std::size_t>(1, size)) {}
+
+    std::vector<Entry> const& ranking() const { return entries; }
+
+    // Scores below this can not make it in any more
+    float minScore() const {
+        return entries.size() < size ? std::numeric_limits<float>::lowest()
+                                     : entries.back().score;
+    }
+
+    std::string thumbnailPath(const int seed) const {
+        return (boost::filesystem::path(dir) / ("seed_" + std::to_string(seed) + ".png")).string();
+    }
+
+    // Whether add would take entry
+    bool admits(Entry const& entry) const {
+        for (Entry const& e : entries) {
+            if (e.seed == entry.seed) return false;
+        }
+        return entries.size() < size ||
+            std::lower_bound(entries.begin(), entries.end(), entry) != entries.end();
+    }
+
+    // Returns false if entry does not make it in or is in already. A seed
+    // that drops out of the catalogue for it goes to evicted.
+    bool add(Entry const& entry, std::vector<int>& evicted) {
+        if (!admits(entry)) return false;
+        const auto it = std::lower_bound(entries.begin(), entries.end(), entry);
+        entries.insert(it, entry);
+        if (entries.size() > size) {
+            evicted.push_back(entries.back().seed);
+            entries.pop_back();
+        }
+        return true;
+    }
+
+    // The ranking as text, replacing the last one only once it is complete
+    bool write() const {
+        namespace fs = boost::filesystem;
+        const fs::path path = fs::path(dir) / "catalogue.txt";
+        const fs::path temporary = fs::path(dir) / "catalogue.txt.tmp";
+        {
+            std::ofstream out(temporary.string());
+            out << std::setprecision(std::numeric_limits<float>::max_digits10)
+                << "# rank seed score thumbnail\n";
+            for (std::size_t i = 0; i < entries.size(); ++i) {
+                out << i + 1 << ' ' << entries[i].seed << ' ' << entries[i].score << ' '
+                    << fs::path(thumbnailPath(entries[i].seed)).filename().string() << '\n';
+            }
+            if (!out.flush()) return false;
+        }
+        boost::system::error_code error;
+        fs::rename(temporary, path, error);
+        return !error;
+    }
+};
+
+// The state of a screening run, shared by the connections to the workers
+class Coordinator {
+    Params params;
+    int first_seed;
+    std::size_t chunk;
+    std::size_t nr_ranges;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    Catalogue catalogue;
+    std::vector<bool> finished;
+    std::size_t nr_finished = 0;
+    // Ranges that were never handed out start at next, the ones that came
+    // back from workers that went away wait in returned
+    std::size_t next = 0;
+    std::deque<std::size_t> returned;
+    std::ofstream journal;
+
+    std::string journalHeader() const {
+        std::ostringstream header;
+        header << "gliders-catalogue " << protocol_version << " | " << paramsLine(params)
+               << " | " << params.seed << ' ' << params.last_seed << ' ' << chunk << ' '
+               << params.farm_top;
+        return header.str();
+    }
+
+public:
+    explicit Coordinator(Params const& params)
+        : params(params), first_seed(std::min(params.seed, params.last_seed)),
+          chunk(std::max<std::size_t>(1, params.farm_chunk)),
+          catalogue(params.output_dir, params.farm_top) {
+        const std::size_t nr_seeds = std::abs(params.last_seed - params.seed) + 1;
+        nr_ranges = (nr_seeds + chunk - 1) / chunk;
+        finished.assign(nr_ranges, false);
+    }
+
+    // Replays the journal of an earlier run with the same parameters, if
+    // there is one, and opens it for appending. Returns false if there is
+    // a journal of different parameters, or if it can not be written.
+    bool open() {
+        namespace fs = boost::filesystem;
+        const std::string path = (fs::path(params.output_dir) / "journal.txt").string();
+
+        std::ifstream in(path);
+        std::string line;
+        if (std::getline(in, line)) {
+            if (line != journalHeader()) {
+                std::cerr << path << " is from a run with other parameters\n";
+                return false;
+            }
+            std::vector<int> evicted;
+            while (std::getline(in, line)) {
+                std::istringstream fields(line);
+                std::string kind;
+                fields >> kind;
+                if (kind == "seed") {
+                    Entry entry;
+                    if (fields >> entry.seed >> entry.score) catalogue.add(entry, evicted);
+                } else if (kind == "range") {
+                    std::size_t range;
+                    if (fields >> range && range < nr_ranges && !finished[range]) {
+                        finished[range] = true;
+                        ++nr_finished;
+                    }
+                }
+            }
+            in.close();
+            journal.open(path, std::ios::app);
+        } else {
+            in.close();
+            journal.open(path);
+            journal << journalHeader() << '\n' << std::flush;
+        }
+        journal << std::setprecision(std::numeric_limits<float>::max_digits10);
+
+        if (nr_finished > 0) {
+            std::cout << "resuming with " << nr_finished << " of " << nr_ranges
+                      << " ranges screened\n";
+        }
+        return static_cast<bool>(journal);
+    }
+
+    bool done() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return nr_finished == nr_ranges;
+    }
+
+    std::pair<int, int> seeds(const std::size_t range) const {
+        const int first = first_seed + static_cast<int>(range * chunk);
+        const int last = std::min(std::max(params.seed, params.last_seed),
+                                  first + static_cast<int>(chunk) - 1);
+        return {first, last};
+    }
+
+    // Waits for a range that is neither screened nor out with another
+    // worker. Returns false once all are screened.
+    bool take(std::size_t& range, float& min_score) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            while (next < nr_ranges && finished[next]) ++next;
+            if (!returned.empty()) {
+                range = returned.front();
+                returned.pop_front();
+                if (finished[range]) continue;
+            } else if (next < nr_ranges) {
+                range = next++;
+            } else if (nr_finished == nr_ranges) {
+                return false;
+            } else {
+                changed.wait(lock);
+                continue;
+            }
+            min_score = catalogue.minScore();
+            return true;
+        }
+    }
+
+    // For a range that a worker did not finish
+    void giveBack(const std::size_t range) {
+        std::lock_guard<std::mutex> lock(mutex);
+        returned.push_back(range);
+        changed.notify_all();
+    }
+
+    // The thumbnail is encoded without holding the lock, so the other
+    // connections can go on meanwhile. A range is only out with one worker
+    // at a time, so no one else writes the thumbnail of the same seed.
+    void add(SeedResult const& result) {
+        if (result.thumbnail.empty()) return;
+        const std::string thumbnail_path = catalogue.thumbnailPath(result.entry.seed);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!catalogue.admits(result.entry)) return;
+        }
+
+        // The thumbnail is there before the journal counts the seed in
+        sf::Image image;
+        image.create(result.width, result.height, result.thumbnail.data());
+        if (!image.saveToFile(thumbnail_path)) {
+            std::cerr << "failed to write " << thumbnail_path << '\n';
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<int> evicted;
+        if (!catalogue.add(result.entry, evicted)) {
+            // Better seeds came in while it was written
+            boost::system::error_code error;
+            boost::filesystem::remove(thumbnail_path, error);
+            return;
+        }
+        journal << "seed " << result.entry.seed << ' ' << result.entry.score << '\n' << std::flush;
+
+        for (const int seed : evicted) {
+            boost::system::error_code error;
+            boost::filesystem::remove(catalogue.thumbnailPath(seed), error);
+        }
+    }
+
+    // Returns true if that was the last range
+    bool finish(const std::size_t range) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!finished[range]) {
+            finished[range] = true;
+            ++nr_finished;
+            journal << "range " << range << '\n' << std::flush;
+            const auto s = seeds(range);
+            std::cout << "screened " << s.first << " to " << s.second << ", "
+                      << nr_finished << " of " << nr_ranges << " ranges\n";
+        }
+        if (!catalogue.write()) std::cerr << "failed to write the catalogue\n";
+        changed.notify_all();
+        return nr_finished == nr_ranges;
+    }
+
+    // Talks to one worker until there is nothing left to do or the worker
+    // goes away. done is called after the last range was finished.
+    template <typename Done>
+    void serve(boost::asio::ip::tcp::socket socket, Done done) {
+        boost::asio::ip::tcp::iostream stream(std::move(socket));
+        stream << std::setprecision(std::numeric_limits<float>::max_digits10)
+               << "gliders-farm " << protocol_version << '\n'
+               << "params " << paramsLine(params) << '\n' << std::flush;
+
+        unsigned thumbnail_width, thumbnail_height;
+        thumbnailSize(params, thumbnail_width, thumbnail_height);
+
+        std::size_t range;
+        float min_score;
+        while (take(range, min_score)) {
+            const auto s = seeds(range);
+            stream.expires_after(std::chrono::seconds(params.farm_timeout));
+            stream << "range " << s.first << ' ' << s.second << ' ' << min_score
+                   << '\n' << std::flush;
+
+            bool complete = false;
+            std::string line;
+            while (std::getline(stream, line)) {
+                std::istringstream fields(line);
+                std::string kind;
+                fields >> kind;
+                if (kind == "finished") {
+                    complete = true;
+                    break;
+                }
+
+                // Anything but thumbnails of the size asked for is a broken
+                // or foreign worker, and its size is not to be trusted
+                SeedResult result;
+                fields >> result.entry.seed >> result.entry.score >> result.width >> result.height;
+                if (kind != "result" || !fields || result.width != thumbnail_width ||
+                    result.height != thumbnail_height) {
+                    break;
+                }
+                const std::size_t size = 4 * static_cast<std::size_t>(result.width) * result.height;
+                result.thumbnail.resize(size);
+                if (!stream.read(reinterpret_cast<char*>(result.thumbnail.data()), size)) break;
+                add(result);
+            }
+
+            if (!complete) {
+                giveBack(range);
+                std::cerr << "lost a worker, seeds " << s.first << " to " << s.second
+                          << " go to another one\n";
+                return;
+            }
+            if (finish(range)) done();
+        }
+        stream.expires_after(std::chrono::seconds(params.farm_timeout));
+        stream << "done\n" << std::flush;
+    }
+};
+
+// Runs a coordinator on params.farm_port until all seeds are screened.
+// Returns 0 if they all were.
+inline int runCoordinator(Params const& params) {
+    namespace fs = boost::filesystem;
+    using boost::asio::ip::tcp;
+
+    if (!fs::exists(params.output_dir)) {
+        fs::create_directories(params.output_dir);
+    }
+
+    Coordinator coordinator(params);
+    if (!coordinator.open()) return 1;
+    if (coordinator.done()) {
+        std::cout << "all seeds are screened already\n";
+        return 0;
+    }
+
+    boost::asio::io_context io;
+    tcp::acceptor acceptor(io, tcp::endpoint(tcp::v4(), params.farm_port));
+    std::cout << "waiting for workers on port " << params.farm_port << '\n';
+
+    std::vector<std::thread> connections;
+    auto done = [&]() {
+        boost::asio::post(io, [&]() { acceptor.close(); });
+    };
+    std::function<void()> accept = [&]() {
+        acceptor.async_accept([&](boost::system::error_code const& error, tcp::socket socket) {
+            if (error) return;
+            socket.set_option(boost::asio::socket_base::keep_alive(true));
+            connections.emplace_back([&coordinator, &done](tcp::socket socket) {
+                coordinator.serve(std::move(socket), done);
+            }, std::move(socket));
+            accept();
+        });
+    };
+    accept();
+    io.run();
+
+    for (auto& connection : connections) connection.join();
+    return coordinator.done() ? 0 : 1;
+}
+
+// Screens the ranges that the coordinator at params.farm_worker, as
+// host:port, hands out, with all threads, until it has no more.
+// Returns 0 if the coordinator said it was done.
+inline int runWorker(Params const& params) {
+    const std::string& address = params.farm_worker;
+    const auto colon = address.rfind(':');
+    const std::string host = address.substr(0, colon);
+    const std::string port = colon == std::string::npos ? "" : address.substr(colon + 1);
+
+    boost::asio::ip::tcp::iostream stream(host, port);
+    if (!stream) {
+        std::cerr << "could not connect to " << address << ": "
+                  << stream.error().message() << '\n';
+        return 1;
+    }
+
+    std::string line, word;
+    int version = 0;
+    Params farm_params = params;
+    if (!(stream >> word >> version) || word != "gliders-farm" || version != protocol_version ||
+        !(stream >> word) || word != "params" || !std::getline(stream, line) ||
+        !readParamsLine(line, farm_params)) {
+        std::cerr << address << " is not a coordinator of this version\n";
+        return 1;
+    }
+
+    std::vector<SeedResult> results;
+    while (stream >> word && word == "range") {
+        int first, last;
+        float min_score;
+        if (!(stream >> first >> last >> min_score) || last < first) break;
+
+        results.assign(last - first + 1, SeedResult());
+        parallel::forEach(results.size(), [&](unsigned, const std::size_t i) {
+            results[i] = screenSeed(farm_params, first + static_cast<int>(i), min_score);
+        }, params.nr_threads);
+
+        stream << std::setprecision(std::numeric_limits<float>::max_digits10);
+        for (SeedResult const& result : results) {
+            if (result.thumbnail.empty()) continue;
+            stream << "result " << result.entry.seed << ' ' << result.entry.score << ' '
+                   << result.width << ' ' << result.height << '\n';
+            stream.write(reinterpret_cast<const char*>(result.thumbnail.data()),
+                         result.thumbnail.size());
+        }
+        stream << "finished\n" << std::flush;
+        std::cout << "screened " << first << " to " << last << '\n';
+    }
+
+    if (word != "done") {
+        std::cerr << "lost the connection to " << address << '\n';
+        return 1;
+    }
+    return 0;
+}
+
+} // namespace farm
+
+#endif // SEED_FARM_HPP
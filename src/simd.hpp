@@ -0,0 +1,125 @@
+#ifndef SIMD_HPP
+#define SIMD_HPP
+
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// Minimal float vector wrapper, just enough to write the field kernels
+// once and have them compile to AVX, NEON or plain scalar code depending
+// on what the compiler is allowed to emit.
+
+namespace simd {
+
+#if defined(__AVX__)
+
+    struct vfloat {
+        static constexpr int width = 8;
+        __m256 v;
+
+        vfloat() {}
+        vfloat(__m256 v) : v(v) {}
+        vfloat(float f) : v(_mm256_set1_ps(f)) {}
+
+        static vfloat load(const float* p) { return _mm256_loadu_ps(p); }
+        void store(float* p) const { _mm256_storeu_ps(p, v); }
+
+        friend vfloat operator+(vfloat a, vfloat b) { return _mm256_add_ps(a.v, b.v); }
+        friend vfloat operator-(vfloat a, vfloat b) { return _mm256_sub_ps(a.v, b.v); }
+        friend vfloat operator*(vfloat a, vfloat b) { return _mm256_mul_ps(a.v, b.v); }
+        friend vfloat operator/(vfloat a, vfloat b) { return _mm256_div_ps(a.v, b.v); }
+        friend vfloat sqrt(vfloat a) { return _mm256_sqrt_ps(a.v); }
+        // About 12 bits
+        friend vfloat rsqrtEstimate(vfloat a) { return _mm256_rsqrt_ps(a.v); }
+        friend vfloat max(vfloat a, vfloat b) { return _mm256_max_ps(a.v, b.v); }
+
+        float sum() const {
+            const __m128 lo = _mm256_castps256_ps128(v);
+            const __m128 hi = _mm256_extractf128_ps(v, 1);
+            __m128 s = _mm_add_ps(lo, hi);
+            s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+            s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+            return _mm_cvtss_f32(s);
+        }
+    };
+
+    // The same estimate as vfloat's for a single float, from the same table
+    inline float rsqrtEstimate(const float a) {
+        return _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(a)));
+    }
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+
+    struct vfloat {
+        static constexpr int width = 4;
+        float32x4_t v;
+
+        vfloat() {}
+        vfloat(float32x4_t v) : v(v) {}
+        vfloat(float f) : v(vdupq_n_f32(f)) {}
+
+        static vfloat load(const float* p) { return vld1q_f32(p); }
+        void store(float* p) const { vst1q_f32(p, v); }
+
+        friend vfloat operator+(vfloat a, vfloat b) { return vaddq_f32(a.v, b.v); }
+        friend vfloat operator-(vfloat a, vfloat b) { return vsubq_f32(a.v, b.v); }
+        friend vfloat operator*(vfloat a, vfloat b) { return vmulq_f32(a.v, b.v); }
+        friend vfloat operator/(vfloat a, vfloat b) { return vdivq_f32(a.v, b.v); }
+        friend vfloat sqrt(vfloat a) { return vsqrtq_f32(a.v); }
+        // The 8 bit estimate with one of NEON's own Newton-Raphson steps,
+        // for about the same 12 bits as on x86
+        friend vfloat rsqrtEstimate(vfloat a) {
+            const float32x4_t e = vrsqrteq_f32(a.v);
+            return vmulq_f32(e, vrsqrtsq_f32(vmulq_f32(a.v, e), e));
+        }
+        friend vfloat max(vfloat a, vfloat b) { return vmaxq_f32(a.v, b.v); }
+
+        float sum() const { return vaddvq_f32(v); }
+    };
+
+    inline float rsqrtEstimate(const float a) {
+        const float e = vrsqrtes_f32(a);
+        return e * vrsqrtss_f32(a * e, e);
+    }
+
+#else
+
+    struct vfloat {
+        static constexpr int width = 1;
+        float v;
+
+        vfloat() {}
+        vfloat(float f) : v(f) {}
+
+        static vfloat load(const float* p) { return *p; }
+        void store(float* p) const { *p = v; }
+
+        friend vfloat operator+(vfloat a, vfloat b) { return a.v + b.v; }
+        friend vfloat operator-(vfloat a, vfloat b) { return a.v - b.v; }
+        friend vfloat operator*(vfloat a, vfloat b) { return a.v * b.v; }
+        friend vfloat operator/(vfloat a, vfloat b) { return a.v / b.v; }
+        friend vfloat sqrt(vfloat a) { return std::sqrt(a.v); }
+        // No estimate to be had, so exact
+        friend vfloat rsqrtEstimate(vfloat a) { return 1.f / std::sqrt(a.v); }
+        friend vfloat max(vfloat a, vfloat b) { return a.v > b.v ? a.v : b.v; }
+
+        float sum() const { return v; }
+    };
+
+    inline float rsqrtEstimate(const float a) { return rsqrtEstimate(vfloat(a)).v; }
+
+#endif
+
+    inline vfloat& operator+=(vfloat& a, vfloat b) { return a = a + b; }
+    inline vfloat& operator-=(vfloat& a, vfloat b) { return a = a - b; }
+
+    // Arrays handed to the kernels are padded to a multiple of this, which
+    // covers every vfloat variant above.
+    constexpr int max_width = 8;
+}
+
+#endif // SIMD_HPP
@@ -0,0 +1,165 @@
+#ifndef SVG_HPP
+#define SVG_HPP
+
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <ostream>
+#include <utility>
+#include <vector>
+#include "point.hpp"
+#include "raster.hpp"
+#include "trajectory_pool.hpp"
+
+// Vector output for plotters and large prints. Polylines go out to the
+// stream as soon as they are added, so a picture of any number of gliders
+// only ever holds one trajectory in memory. They are simplified first, as
+// the many short, nearly collinear steps of a glider would make the files
+// large for no visible difference.
+
+// Ramer-Douglas-Peucker simplification: keeps the fewest points such that
+// no point that is dropped is further than tolerance from the segment that
+// replaces it. The buffers are kept, so a simplifier that is reused for
+// many polylines stops allocating.
+class PolylineSimplifier {
+    std::vector<point> out;
+    std::vector<bool> keep;
+    std::vector<std::pair<std::size_t, std::size_t>> stack;
+
+public:
+    // The simplified polyline, valid until the next call
+    PointSpan simplify(PointSpan points, const float tolerance) {
+        out.clear();
+        if (points.size() <= 2) {
+            out.assign(points.begin(), points.end());
+            return out;
+        }
+
+        keep.assign(points.size(), false);
+        keep.front() = keep.back() = true;
+        const float sq_tolerance = tolerance * tolerance;
+
+        stack.clear();
+        stack.emplace_back(0, points.size() - 1);
+        while (!stack.empty()) {
+            const std::size_t first = stack.back().first;
+            const std::size_t last = stack.back().second;
+            stack.pop_back();
+
+            const point a = points[first];
+            const point ab = points[last] - a;
+            const float sq_len = ab.sqmag();
+
+            float max_sq_dist = 0;
+            std::size_t furthest = first;
+            for (std::size_t i = first + 1; i < last; ++i) {
+                const point ap = points[i] - a;
+                // Distance to the segment from a to b, not to the line
+                // through them, so that the far end of a hairpin turn
+                // around a planet counts as far away
+                const float t = sq_len > 0
+                    ? std::fmin(1.f, std::fmax(0.f, ab.dotp(ap) / sq_len))
+                    : 0.f;
+                const float sq_dist = (ap - ab * t).sqmag();
+                if (sq_dist > max_sq_dist) {
+                    max_sq_dist = sq_dist;
+                    furthest = i;
+                }
+            }
+
+            if (max_sq_dist > sq_tolerance) {
+                keep[furthest] = true;
+                if (furthest - first > 1) stack.emplace_back(first, furthest);
+                if (last - furthest > 1) stack.emplace_back(furthest, last);
+            }
+        }
+
+        for (std::size_t i = 0; i < points.size(); ++i) {
+            if (keep[i]) out.push_back(points[i]);
+        }
+        return out;
+    }
+};
+
+// Writes an SVG document of width x height user units that shows the
+// rectangle bounds. Polylines are drawn in groups that share a stroke, and
+// the document is complete once finish() was called or the writer is
+// destroyed.
+class SvgWriter {
+    std::ostream& out;
+    point origin;
+    float scale_x, scale_y;
+    bool in_group = false;
+    bool finished = false;
+
+    static void colour(std::ostream& out, const char* name, Rgba const& c) {
+        char buffer[64];
+        std::snprintf(buffer, sizeof(buffer), " %s=\"#%02x%02x%02x\" %s-opacity=\"%.3g\"",
+                      name, channel(c.r), channel(c.g), channel(c.b), name, c.a);
+        out << buffer;
+    }
+
+    static unsigned channel(const float v) {
+        return static_cast<unsigned>(std::fmin(1.f, std::fmax(0.f, v)) * 255.f + 0.5f);
+    }
+
+public:
+    SvgWriter(std::ostream& out, std::array<point, 2> const& bounds,
+              const unsigned width, const unsigned height, Rgba const& background)
+        : out(out), origin(bounds[0]) {
+        const point size = bounds[1] - bounds[0];
+        scale_x = size.x > 0 ? width / size.x : 1.f;
+        scale_y = size.y > 0 ? height / size.y : 1.f;
+
+        out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+            << "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"" << width
+            << "\" height=\"" << height << "\" viewBox=\"0 0 " << width << ' ' << height
+            << "\">\n<rect width=\"100%\" height=\"100%\"";
+        colour(out, "fill", background);
+        out << "/>\n";
+    }
+
+    SvgWriter(SvgWriter const&) = delete;
+    SvgWriter& operator=(SvgWriter const&) = delete;
+    ~SvgWriter() { finish(); }
+
+    // The following polylines are stroked with colour and stroke_width
+    void beginGroup(Rgba const& stroke, const float stroke_width = 1.f) {
+        endGroup();
+        out << "<g fill=\"none\" stroke-width=\"" << stroke_width
+            << "\" stroke-linejoin=\"round\" stroke-linecap=\"round\"";
+        colour(out, "stroke", stroke);
+        out << ">\n";
+        in_group = true;
+    }
+
+    void endGroup() {
+        if (in_group) out << "</g>\n";
+        in_group = false;
+    }
+
+    void polyline(PointSpan points) {
+        if (points.size() < 2) return;
+
+        char buffer[32];
+        out << "<polyline points=\"";
+        for (std::size_t i = 0; i < points.size(); ++i) {
+            const float x = (points[i].x - origin.x) * scale_x;
+            const float y = (points[i].y - origin.y) * scale_y;
+            if (!std::isfinite(x) || !std::isfinite(y)) continue;
+            std::snprintf(buffer, sizeof(buffer), i ? " %.2f,%.2f" : "%.2f,%.2f", x, y);
+            out << buffer;
+        }
+        out << "\"/>\n";
+    }
+
+    void finish() {
+        if (finished) return;
+        endGroup();
+        out << "</svg>\n";
+        out.flush();
+        finished = true;
+    }
+};
+
+#endif // SVG_HPP
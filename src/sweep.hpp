@@ -0,0 +1,100 @@
+#ifndef SWEEP_HPP
+#define SWEEP_HPP
+
+#include <cmath>
+#include <random>
+#include <vector>
+#include "glider.hpp"
+#include "point.hpp"
+#include "profile.hpp"
+#include "search.hpp"
+#include "system.hpp"
+
+// Animations of a seed with its parameters changing from frame to frame.
+// The parameters move linearly from the first to the last frame: the
+// spiral factor between two values, the planet masses by a factor, and
+// every planet along a straight line in a random direction. Consecutive
+// frames are then so alike that a lot of the work of one frame can be
+// kept for the next, see NicePathTracker here and BarnesHut::refit.
+
+struct SweepSchedule {
+    std::size_t nr_frames = 1;
+    float spiral_from = 4.f;
+    float spiral_to = 4.f;
+    // The planet masses are multiplied by 1 in the first frame and by this
+    // in the last
+    float mass_to = 1.f;
+    // How far every planet moves over the whole animation, in pixels
+    float drift = 0.f;
+};
+
+struct SweepFrame {
+    // 0 in the first frame, 1 in the last
+    float t;
+    float spiral_factor;
+    float mass_factor;
+};
+
+inline SweepFrame sweepFrame(SweepSchedule const& schedule, const std::size_t frame) {
+    const float t = schedule.nr_frames > 1
+        ? static_cast<float>(frame) / (schedule.nr_frames - 1) : 0.f;
+    return {t, schedule.spiral_from + t * (schedule.spiral_to - schedule.spiral_from),
+            1.f + t * (schedule.mass_to - 1.f)};
+}
+
+// The planets of base in the given frame. The directions the planets drift
+// in only depend on seed.
+inline std::vector<Planet> sweepPlanets(std::vector<Planet> const& base,
+                                        SweepSchedule const& schedule,
+                                        const std::size_t frame, const int seed) {
+    const SweepFrame f = sweepFrame(schedule, frame);
+
+    // Offset seed to avoid collision with the planets and the candidates
+    std::mt19937 rng(seed + 4000);
+    std::uniform_real_distribution<float> angle(0.f, 2 * std::acos(-1.f));
+
+    std::vector<Planet> planets = base;
+    for (Planet& p : planets) {
+        const float a = angle(rng);
+        p.pos += point(std::cos(a), std::sin(a)) * (f.t * schedule.drift);
+        p.mass *= f.mass_factor;
+    }
+    return planets;
+}
+
+// Finds the nice path of every frame of an animation. The first frame gets
+// a full search with the chosen strategy, and every frame after that a
+// warmStartSearch from the start of the previous frame's path. That is
+// about two thirds of the work of a refine search, and the path stays
+// where it was unless a better one appears, so it does not flicker
+// between frames.
+class NicePathTracker {
+    bool has_previous = false;
+    NicePath previous;
+
+public:
+    template <typename Field>
+    NicePath next(System const& system, Field const& field, const float spiral_factor,
+                  const std::size_t max_steps, std::array<point, 2> const& bounds,
+                  const int seed, const SearchStrategy strategy,
+                  const unsigned nr_threads = 0, const std::size_t attempts = 1000) {
+        if (!has_previous) {
+            previous = findNicePath(system, field, spiral_factor, max_steps, bounds, seed,
+                                    strategy, nr_threads, attempts);
+            has_previous = true;
+            return previous;
+        }
+
+        profile::ScopedTimer timer ("find nice path");
+        CandidateEvaluator<Field> evaluator (system, field, bounds, spiral_factor, nr_threads);
+        GliderStart start;
+        start.pos = previous.start;
+        start.ccw = previous.ccw;
+        previous = warmStartSearch(evaluator, max_steps, seed, start);
+        return previous;
+    }
+
+    void reset() { has_previous = false; }
+};
+
+#endif // SWEEP_HPP
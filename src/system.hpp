@@ -2,7 +2,10 @@
 #define SYSTEM_HPP
 
 #include <array>
+#include <vector>
 #include "point.hpp"
+#include "planet_arrays.hpp"
+#include "profile.hpp"
 
 // System as in solar system, but not really, because the masses are
 // all stationary.
@@ -18,73 +21,103 @@ class System {
 
     const float gravitational_constant = 2000.0;
 
+    std::vector<Planet> planet_list;
+
+    // Same planets, laid out for the vectorized probes. Has to be
+    // refreshed whenever the planets change, which is why they only
+    // change through setPlanets.
+    PlanetArrays planet_arrays;
+
+    void updatePlanetArrays() {
+        planet_arrays.clear();
+        for (auto const& p : planet_list) {
+            planet_arrays.push(p.pos, p.mass, p.ccw, gravitational_constant);
+        }
+        planet_arrays.pad();
+    }
+
     template<typename RNG>
     void populatePlanets(const int n, const float max_mass, RNG &rng) {
-        planets.resize(n);
+        planet_list.resize(n);
         std::uniform_real_distribution<float> dist_mass(0, max_mass);
         std::bernoulli_distribution dist_ccw(0.5);
-        for(auto &p:planets){
+        for(auto &p:planet_list){
             const bool ccw = dist_ccw(rng);
             p = {point::randomPoint(bounds, rng), dist_mass(rng), ccw};
         }
     }
 
 public:
-    std::vector<Planet> planets;
-
     template<typename RNG>
     System(const int n, std::array<point, 2> const& bounds, RNG &rng) : bounds(bounds) {
+        profile::ScopedTimer timer ("build system");
+        profile::count(profile::Counter::systems);
+        profile::count(profile::Counter::planets, n);
         populatePlanets(n, 1.0, rng);
+        updatePlanetArrays();
+    }
+
+    System(std::vector<Planet> planets, std::array<point, 2> const& bounds)
+        : bounds(bounds), planet_list(std::move(planets)) {
+        updatePlanetArrays();
     }
 
     System& operator=(System const& other) {
         bounds = other.bounds;
-        planets = other.planets;
+        planet_list = other.planet_list;
+        planet_arrays = other.planet_arrays;
         return *this;
     }
 
     System& operator=(System&& other) {
         bounds = std::move(other.bounds);
-        planets = std::move(other.planets);
+        planet_list = std::move(other.planet_list);
+        planet_arrays = std::move(other.planet_arrays);
         return *this;
     }
 
-    point probeGravity(point const& pos) const {
-        point out {0.f, 0.f};
-        for (auto &p:planets) {
-            const point r = pos - p.pos;
-            out -= r.norm() / r.sqmag() * p.mass;
-        }
+    std::vector<Planet> const& planets() const { return planet_list; }
+
+    PlanetArrays const& planetArrays() const { return planet_arrays; }
 
-        return out * gravitational_constant;
+    float gravitationalConstant() const { return gravitational_constant; }
+
+    void setPlanets(std::vector<Planet> new_planets) {
+        planet_list = std::move(new_planets);
+        updatePlanetArrays();
     }
 
-    float probePotential(point const& pos) const {
-        float out = 0.f;
-        for (auto &p:planets) {
-            out -= p.mass / (pos - p.pos).mag();
-        }
+    point probeGravity(point const& pos) const {
+        return kernels::gravity(planet_arrays, pos) * gravitational_constant;
+    }
 
-        return out * gravitational_constant;
+    float probePotential(point const& pos) const {
+        return kernels::potential(planet_arrays, pos) * gravitational_constant;
     }
 
     point probeAngularPotentialGradient(point const& pos) const {
-        point out (0.f, 0.f);
+        return kernels::angularGradient(planet_arrays, pos);
+    }
 
-        for (auto const& p : planets) {
-            const point r = pos - p.pos;
-            const float planet_contribution =
-                p.mass * (p.ccw ? 1 : -1) / r.sqmag();
+    // Gradient of gravitational potential plus angular_factor times the
+    // angular potential, i.e. -probeGravity(pos) - angular_factor *
+    // probeAngularPotentialGradient(pos), in one pass over the planets.
+    point probeTotalGradient(point const& pos, const float angular_factor) const {
+        return kernels::totalGradient(planet_arrays, pos, angular_factor);
+    }
 
-            out += point(r.y, -r.x) * planet_contribution;
-        }
+    PointBatch probeTotalGradient(PointBatch const& pos, const float angular_factor) const {
+        return kernels::totalGradient(planet_arrays, pos, angular_factor);
+    }
 
-        return out;
+    // One lane of the batch probe, for gliders integrated on their own
+    point probeLaneTotalGradient(point const& pos, const float angular_factor) const {
+        return kernels::laneTotalGradient(planet_arrays, pos, angular_factor);
     }
 
     float probeWeightedAngleDiff(point const& a, point const& b) const {
         float weighted_angle_diff = 0.f;
-        for (auto const& p : planets) {
+        for (auto const& p : planet_list) {
             const point r_a = a - p.pos;
             const point r_b = b - p.pos;
 
@@ -0,0 +1,195 @@
+#ifndef TILED_RENDER_HPP
+#define TILED_RENDER_HPP
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "parallel.hpp"
+#include "point.hpp"
+#include "profile.hpp"
+#include "raster.hpp"
+
+// Renders trajectories into pictures of any size, like a print at many
+// times the resolution of the screen. The picture is cut into square
+// tiles. Every tile is drawn supersampled on a canvas of its own and then
+// scaled down, and only a row of tiles is kept at a time, which goes to
+// the writer row by row before the next one is drawn.
+//
+// Before drawing, one pass over the trajectories sorts their segments into
+// the tiles they touch, so a tile only looks at its own segments. The
+// segments of a trajectory in a tile are kept as runs, runs of segments of
+// the same trajectory, which are few as the steps are short compared to a
+// tile.
+
+struct TiledRenderOptions {
+    // Size of the output in pixels
+    unsigned width = 1800;
+    unsigned height = 1000;
+    unsigned tile_size = 256;
+    // Every output pixel is the average of supersample^2 samples
+    unsigned supersample = 4;
+    // In output pixels
+    float line_width = 1.f;
+    Rgba background = Rgba::fromBytes(30, 30, 30);
+    Rgba colour = Rgba::fromBytes(255, 255, 255, 20);
+    // Drawn on top of the others
+    Rgba highlight_colour = Rgba::fromBytes(255, 0, 0);
+    // 0 for all cores
+    unsigned nr_threads = 0;
+};
+
+namespace detail {
+    // Segments [first, last) of trajectory, segment j going from point j
+    // to point j + 1
+    struct SegmentRun {
+        std::uint32_t trajectory;
+        std::uint32_t first, last;
+    };
+}
+
+// Draws trajectories, anything with size() and an operator[] that gives
+// something with size() and operator[] for the points, like a
+// TrajectoryPool or a TrajectoryFile. The rectangle bounds is stretched
+// to the output size. Trajectory highlight, if there is one with that
+// index, is drawn in the highlight colour on top. writer gets the rows
+// through writeRow(rgb). Returns writer.ok() at the end.
+template <typename Trajectories, typename RowWriter>
+bool renderTiled(Trajectories const& trajectories, const std::size_t highlight,
+                 std::array<point, 2> const& bounds, TiledRenderOptions const& options,
+                 RowWriter& writer) {
+    profile::ScopedTimer timer ("render tiles");
+
+    const unsigned tile = std::max(1u, options.tile_size);
+    const unsigned ss = std::max(1u, options.supersample);
+    const unsigned tiles_x = (options.width + tile - 1) / tile;
+    const unsigned tiles_y = (options.height + tile - 1) / tile;
+
+    const point size = bounds[1] - bounds[0];
+    const point scale(size.x > 0 ? options.width / size.x : 1.f,
+                      size.y > 0 ? options.height / size.y : 1.f);
+    auto toOutput = [&](point const& p) {
+        return point((p.x - bounds[0].x) * scale.x, (p.y - bounds[0].y) * scale.y);
+    };
+
+    // Segments reach this far beyond their end points, with the
+    // antialiasing of thin lines
+    const float margin = options.line_width / 2 + 1;
+
+    std::vector<std::vector<detail::SegmentRun>> runs(tiles_x * tiles_y);
+    {
+        profile::ScopedTimer bucket_timer ("bucket segments");
+        for (std::size_t t = 0; t < trajectories.size(); ++t) {
+            auto const& points = trajectories[t];
+            for (std::size_t j = 0; j + 1 < points.size(); ++j) {
+                const point a = toOutput(points[j]);
+                const point b = toOutput(points[j + 1]);
+                if (!(std::isfinite(a.x) && std::isfinite(a.y) &&
+                      std::isfinite(b.x) && std::isfinite(b.y))) {
+                    continue;
+                }
+
+                const float min_x = std::min(a.x, b.x) - margin;
+                const float max_x = std::max(a.x, b.x) + margin;
+                const float min_y = std::min(a.y, b.y) - margin;
+                const float max_y = std::max(a.y, b.y) + margin;
+                if (max_x < 0 || max_y < 0 || min_x >= options.width || min_y >= options.height) {
+                    continue;
+                }
+
+                const unsigned first_x = std::max(0.f, min_x) / tile;
+                const unsigned first_y = std::max(0.f, min_y) / tile;
+                const unsigned last_x = std::min<float>(tiles_x - 1, max_x / tile);
+                const unsigned last_y = std::min<float>(tiles_y - 1, max_y / tile);
+                for (unsigned ty = first_y; ty <= last_y; ++ty) {
+                    for (unsigned tx = first_x; tx <= last_x; ++tx) {
+                        auto& bucket = runs[ty * tiles_x + tx];
+                        if (!bucket.empty() && bucket.back().trajectory == t &&
+                            bucket.back().last == j) {
+                            ++bucket.back().last;
+                        } else {
+                            bucket.push_back({static_cast<std::uint32_t>(t),
+                                              static_cast<std::uint32_t>(j),
+                                              static_cast<std::uint32_t>(j + 1)});
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    const unsigned nr_threads = parallel::threadCountFor(tiles_x, options.nr_threads);
+    std::vector<Canvas> canvases(nr_threads,
+        Canvas(tile * ss, tile * ss, options.background));
+    std::vector<std::uint8_t> band(3 * static_cast<std::size_t>(options.width) * tile);
+
+    // Wide lines cover the pixels whose centres they contain, which leaves
+    // gaps in lines much thinner than a sample, so those are drawn
+    // antialiased instead
+    const float sample_width = options.line_width * ss;
+    const float inv_samples = 1.f / (ss * ss);
+
+    for (unsigned ty = 0; ty < tiles_y && writer.ok(); ++ty) {
+        const unsigned band_height = std::min(tile, options.height - ty * tile);
+
+        parallel::forEach(tiles_x, [&](const unsigned thread, const std::size_t tx) {
+            profile::ScopedTimer tile_timer ("draw tile");
+            Canvas& canvas = canvases[thread];
+            canvas.clear(options.background);
+            const point origin(tx * tile, ty * tile);
+
+            auto draw = [&](detail::SegmentRun const& run, Rgba const& colour) {
+                auto const& points = trajectories[run.trajectory];
+                point a = (toOutput(points[run.first]) - origin) * ss;
+                for (std::uint32_t j = run.first; j < run.last; ++j) {
+                    const point b = (toOutput(points[j + 1]) - origin) * ss;
+                    if (sample_width < 2) {
+                        canvas.drawLine(a, b, colour);
+                    } else {
+                        canvas.drawWideLine(a, b, colour, sample_width);
+                    }
+                    a = b;
+                }
+            };
+
+            auto const& bucket = runs[ty * tiles_x + tx];
+            for (auto const& run : bucket) {
+                if (run.trajectory != highlight) draw(run, options.colour);
+            }
+            for (auto const& run : bucket) {
+                if (run.trajectory == highlight) draw(run, options.highlight_colour);
+            }
+
+            const unsigned tile_width = std::min<unsigned>(tile, options.width - tx * tile);
+            for (unsigned y = 0; y < band_height; ++y) {
+                std::uint8_t* out = &band[3 * (static_cast<std::size_t>(y) * options.width
+                                               + tx * tile)];
+                for (unsigned x = 0; x < tile_width; ++x, out += 3) {
+                    float sum[3] = {0.f, 0.f, 0.f};
+                    for (unsigned sy = 0; sy < ss; ++sy) {
+                        for (unsigned sx = 0; sx < ss; ++sx) {
+                            const float* p = canvas.pixel(x * ss + sx, y * ss + sy);
+                            sum[0] += p[0];
+                            sum[1] += p[1];
+                            sum[2] += p[2];
+                        }
+                    }
+                    for (int c = 0; c < 3; ++c) {
+                        const float v = std::min(1.f, std::max(0.f, sum[c] * inv_samples));
+                        out[c] = static_cast<std::uint8_t>(v * 255.f + 0.5f);
+                    }
+                }
+            }
+        }, nr_threads);
+
+        profile::ScopedTimer write_timer ("write rows");
+        for (unsigned y = 0; y < band_height; ++y) {
+            writer.writeRow(&band[3 * static_cast<std::size_t>(y) * options.width]);
+        }
+    }
+
+    return writer.ok();
+}
+
+#endif // TILED_RENDER_HPP
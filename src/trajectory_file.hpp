@@ -0,0 +1,292 @@
+#ifndef TRAJECTORY_FILE_HPP
+#define TRAJECTORY_FILE_HPP
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "point.hpp"
+#include "profile.hpp"
+#include "trajectory_pool.hpp"
+
+// The trajectories of a seed as a file, so a picture can be drawn again,
+// larger or in a different style, without integrating the gliders again.
+//
+// A file is the TrajectoryFileHeader, then nr_trajectories + 1 offsets into
+// the payload as uint64, then the payload: every point as two int16, x
+// and y, quantized to 65536 steps over the bounding box of all points.
+// Trajectory i is made of the points [offsets[i], offsets[i + 1]). With
+// the default picture size a step usually stays below a tenth of a pixel,
+// and a point takes half the space of two floats. Everything is in
+// the byte order of the machine that wrote it, which open() checks with
+// the magic number.
+//
+// TrajectoryFile maps the file instead of reading it, so only the parts
+// that are drawn are ever loaded.
+
+struct TrajectoryFileHeader {
+    static const std::uint32_t current_version = 1;
+
+    char magic[4];
+    std::uint32_t version;
+
+    // How the trajectories were made, filled in by the caller of
+    // writeTrajectoryFile
+    std::int32_t seed;
+    std::uint32_t nr_planets;
+    float spiral_factor;
+    std::uint32_t max_steps;
+    std::uint32_t step_method; // integrator::Method
+    std::int32_t nice_path_seed;
+    // Rectangle of the picture, min and max corner
+    float bounds[4];
+
+    // Filled in by writeTrajectoryFile
+    std::uint32_t nr_trajectories;
+    // Index of the nice path among the trajectories, -1 for none
+    std::int32_t nice_path;
+    std::uint64_t nr_points;
+    // A point is origin + (q + 32768) * scale for the stored q
+    float origin[2];
+    float scale[2];
+};
+
+static_assert(sizeof(TrajectoryFileHeader) == 80,
+              "TrajectoryFileHeader must not have padding");
+
+namespace detail {
+    inline bool isTrajectoryMagic(const char* magic) {
+        return std::memcmp(magic, "GTRJ", 4) == 0;
+    }
+
+    inline std::int16_t quantize(const float v, const float origin, const float scale) {
+        if (!std::isfinite(v)) return -32768;
+        const float q = std::round((v - origin) / scale) - 32768.f;
+        return static_cast<std::int16_t>(std::min(32767.f, std::max(-32768.f, q)));
+    }
+}
+
+// Writes trajectories, anything with size() and operator[] giving a
+// PointSpan like a TrajectoryPool, and nice_path after them if it is not
+// empty. info has the fields about how the trajectories were made filled
+// in. Returns false if the file could not be written.
+template <typename Trajectories>
+bool writeTrajectoryFile(std::string const& path, TrajectoryFileHeader info,
+                         Trajectories const& trajectories, PointSpan nice_path = {}) {
+    profile::ScopedTimer timer ("write trajectories");
+
+    const std::size_t nr_gliders = trajectories.size();
+    const std::size_t count = nr_gliders + (nice_path.empty() ? 0 : 1);
+    auto trajectory = [&](const std::size_t i) -> PointSpan {
+        return i < nr_gliders ? PointSpan(trajectories[i]) : nice_path;
+    };
+
+    float min_x = std::numeric_limits<float>::max(), min_y = min_x;
+    float max_x = std::numeric_limits<float>::lowest(), max_y = max_x;
+    std::uint64_t nr_points = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        for (point const& p : trajectory(i)) {
+            if (!std::isfinite(p.x) || !std::isfinite(p.y)) continue;
+            min_x = std::min(min_x, p.x);
+            min_y = std::min(min_y, p.y);
+            max_x = std::max(max_x, p.x);
+            max_y = std::max(max_y, p.y);
+        }
+        nr_points += trajectory(i).size();
+    }
+    if (min_x > max_x) {
+        min_x = max_x = min_y = max_y = 0.f;
+    }
+
+    std::memcpy(info.magic, "GTRJ", 4);
+    info.version = TrajectoryFileHeader::current_version;
+    info.nr_trajectories = static_cast<std::uint32_t>(count);
+    info.nice_path = nice_path.empty() ? -1 : static_cast<std::int32_t>(nr_gliders);
+    info.nr_points = nr_points;
+    info.origin[0] = min_x;
+    info.origin[1] = min_y;
+    info.scale[0] = max_x > min_x ? (max_x - min_x) / 65535.f : 1.f;
+    info.scale[1] = max_y > min_y ? (max_y - min_y) / 65535.f : 1.f;
+
+    std::ofstream out(path, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(&info), sizeof(info));
+
+    std::vector<std::uint64_t> offsets;
+    offsets.reserve(count + 1);
+    offsets.push_back(0);
+    for (std::size_t i = 0; i < count; ++i) {
+        offsets.push_back(offsets.back() + trajectory(i).size());
+    }
+    out.write(reinterpret_cast<const char*>(offsets.data()),
+              offsets.size() * sizeof(std::uint64_t));
+
+    // The payload goes out in chunks, so it is never all in memory at once
+    std::vector<std::int16_t> chunk;
+    const std::size_t chunk_size = 1 << 16;
+    chunk.reserve(chunk_size);
+    auto flush = [&]() {
+        out.write(reinterpret_cast<const char*>(chunk.data()),
+                  chunk.size() * sizeof(std::int16_t));
+        chunk.clear();
+    };
+    for (std::size_t i = 0; i < count; ++i) {
+        for (point const& p : trajectory(i)) {
+            chunk.push_back(detail::quantize(p.x, info.origin[0], info.scale[0]));
+            chunk.push_back(detail::quantize(p.y, info.origin[1], info.scale[1]));
+            if (chunk.size() >= chunk_size) flush();
+        }
+    }
+    flush();
+
+    return static_cast<bool>(out);
+}
+
+// One trajectory of a TrajectoryFile, decoded point by point from the
+// mapped file
+class QuantizedSpan {
+    const std::int16_t* coords = nullptr;
+    std::size_t count = 0;
+    point origin, scale;
+
+public:
+    QuantizedSpan() {}
+    QuantizedSpan(const std::int16_t* coords, const std::size_t count,
+                  point const& origin, point const& scale)
+        : coords(coords), count(count), origin(origin), scale(scale) {}
+
+    std::size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    point operator[](const std::size_t i) const {
+        return point(origin.x + (coords[2 * i] + 32768.f) * scale.x,
+                     origin.y + (coords[2 * i + 1] + 32768.f) * scale.y);
+    }
+};
+
+// Read-only, memory mapped view of a file written by writeTrajectoryFile
+class TrajectoryFile {
+    void* mapping = nullptr;
+    std::size_t mapping_size = 0;
+
+    TrajectoryFileHeader const* header_ = nullptr;
+    const std::uint64_t* offsets = nullptr;
+    const std::int16_t* coords = nullptr;
+
+public:
+    TrajectoryFile() {}
+    TrajectoryFile(TrajectoryFile const&) = delete;
+    TrajectoryFile& operator=(TrajectoryFile const&) = delete;
+    ~TrajectoryFile() { close(); }
+
+    // Maps the file at path. Returns false if it can not be read or is not
+    // a complete trajectory file of the current version.
+    bool open(std::string const& path) {
+        close();
+
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat info;
+        const bool have_size = fstat(fd, &info) == 0;
+        const std::size_t size = have_size ? static_cast<std::size_t>(info.st_size) : 0;
+        void* data = MAP_FAILED;
+        if (size >= sizeof(TrajectoryFileHeader)) {
+            data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        ::close(fd);
+        if (data == MAP_FAILED) return false;
+
+        mapping = data;
+        mapping_size = size;
+        if (!validate()) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        if (mapping) munmap(mapping, mapping_size);
+        mapping = nullptr;
+        mapping_size = 0;
+        header_ = nullptr;
+        offsets = nullptr;
+        coords = nullptr;
+    }
+
+    bool isOpen() const { return mapping != nullptr; }
+
+    TrajectoryFileHeader const& header() const { return *header_; }
+
+    std::array<point, 2> bounds() const {
+        return {point(header_->bounds[0], header_->bounds[1]),
+                point(header_->bounds[2], header_->bounds[3])};
+    }
+
+    std::size_t size() const { return header_->nr_trajectories; }
+
+    bool hasNicePath() const { return header_->nice_path >= 0; }
+
+    // Number of trajectories without the nice path
+    std::size_t nrGliders() const { return size() - (hasNicePath() ? 1 : 0); }
+
+    QuantizedSpan operator[](const std::size_t i) const {
+        return {coords + 2 * offsets[i], static_cast<std::size_t>(offsets[i + 1] - offsets[i]),
+                point(header_->origin[0], header_->origin[1]),
+                point(header_->scale[0], header_->scale[1])};
+    }
+
+    QuantizedSpan nicePath() const {
+        return hasNicePath() ? (*this)[header_->nice_path] : QuantizedSpan();
+    }
+
+    // Trajectory i as points, into out, which keeps its capacity
+    void decode(const std::size_t i, std::vector<point>& out) const {
+        const QuantizedSpan span = (*this)[i];
+        out.resize(span.size());
+        for (std::size_t j = 0; j < span.size(); ++j) {
+            out[j] = span[j];
+        }
+    }
+
+private:
+    bool validate() {
+        header_ = static_cast<TrajectoryFileHeader const*>(mapping);
+        if (!detail::isTrajectoryMagic(header_->magic) ||
+            header_->version != TrajectoryFileHeader::current_version) {
+            return false;
+        }
+
+        const std::uint64_t nr_offsets = std::uint64_t(header_->nr_trajectories) + 1;
+        const std::uint64_t payload_start =
+            sizeof(TrajectoryFileHeader) + nr_offsets * sizeof(std::uint64_t);
+        if (payload_start > mapping_size ||
+            (mapping_size - payload_start) / (2 * sizeof(std::int16_t)) < header_->nr_points) {
+            return false;
+        }
+        if (header_->nice_path >= 0 &&
+            static_cast<std::uint32_t>(header_->nice_path) >= header_->nr_trajectories) {
+            return false;
+        }
+
+        const char* bytes = static_cast<const char*>(mapping);
+        offsets = reinterpret_cast<const std::uint64_t*>(bytes + sizeof(TrajectoryFileHeader));
+        coords = reinterpret_cast<const std::int16_t*>(bytes + payload_start);
+
+        if (offsets[0] != 0 || offsets[nr_offsets - 1] != header_->nr_points) return false;
+        for (std::uint64_t i = 1; i < nr_offsets; ++i) {
+            if (offsets[i] < offsets[i - 1]) return false;
+        }
+        return true;
+    }
+};
+
+#endif // TRAJECTORY_FILE_HPP
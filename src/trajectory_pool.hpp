@@ -0,0 +1,62 @@
+#ifndef TRAJECTORY_POOL_HPP
+#define TRAJECTORY_POOL_HPP
+
+#include <cstddef>
+#include <vector>
+#include "point.hpp"
+
+// Read-only view of a run of points, like a trajectory stored in a
+// std::vector or in a TrajectoryPool.
+class PointSpan {
+    const point* first = nullptr;
+    std::size_t count = 0;
+
+public:
+    PointSpan() {}
+    PointSpan(const point* first, const std::size_t count) : first(first), count(count) {}
+    PointSpan(std::vector<point> const& points) : first(points.data()), count(points.size()) {}
+
+    const point* data() const { return first; }
+    std::size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    const point* begin() const { return first; }
+    const point* end() const { return first + count; }
+    point const& operator[](const std::size_t i) const { return first[i]; }
+};
+
+// Storage for many fixed step trajectories in a single block. Every
+// trajectory gets a slot of max_points points, so the slots can be filled
+// from several threads at once without locking. reset() only allocates
+// when the pool has to grow, so a pool that is kept around for the
+// candidates of a search or across redraws stops allocating after the
+// first use.
+class TrajectoryPool {
+    std::size_t stride = 0;
+    std::vector<point> points;
+    std::vector<std::size_t> lengths;
+
+public:
+    // Makes room for count empty trajectories of up to max_points points
+    void reset(const std::size_t count, const std::size_t max_points) {
+        stride = max_points;
+        if (points.size() < count * stride) {
+            points.resize(count * stride);
+        }
+        lengths.assign(count, 0);
+    }
+
+    std::size_t size() const { return lengths.size(); }
+
+    // Appends p to trajectory i. Adding more than max_points points to a
+    // trajectory is not allowed.
+    void push(const std::size_t i, point const& p) {
+        points[i * stride + lengths[i]++] = p;
+    }
+
+    PointSpan operator[](const std::size_t i) const {
+        return {points.data() + i * stride, lengths[i]};
+    }
+};
+
+#endif // TRAJECTORY_POOL_HPP
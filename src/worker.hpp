@@ -0,0 +1,142 @@
+#ifndef WORKER_HPP
+#define WORKER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs jobs on a background thread, one at a time, so that long
+// computations don't block the thread that handles the window. Starting a
+// job cancels the one that is running and replaces one that is still
+// waiting. Cancelling is cooperative: a job gets a flag that it should
+// check every now and then, and return early once it is set.
+//
+// Jobs hand their results back through post(), and the owning thread runs
+// everything that was posted when it calls runPosted(). Results posted by
+// a job after it was cancelled are dropped, so the owner only ever sees
+// results of the latest job.
+
+class BackgroundWorker {
+public:
+    using Cancelled = std::atomic<bool>;
+    using Job = std::function<void(Cancelled const&)>;
+
+private:
+    struct Task {
+        Job job;
+        std::shared_ptr<Cancelled> cancelled;
+    };
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    Task pending;
+    bool has_pending = false;
+    bool running = false;
+    bool quit = false;
+    std::shared_ptr<Cancelled> current;
+
+    std::mutex posted_mutex;
+    std::vector<std::pair<std::shared_ptr<Cancelled>, std::function<void()>>> posted;
+
+    std::thread thread;
+
+    void loop() {
+        for (;;) {
+            Task task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return quit || has_pending; });
+                if (quit) return;
+                task = std::move(pending);
+                has_pending = false;
+                running = true;
+            }
+
+            try {
+                task.job(*task.cancelled);
+            } catch (std::exception const& e) {
+                std::cerr << "background job failed: " << e.what() << '\n';
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+    }
+
+public:
+    BackgroundWorker() : thread([this] { loop(); }) {}
+
+    ~BackgroundWorker() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+            if (current) *current = true;
+        }
+        wake.notify_one();
+        thread.join();
+    }
+
+    BackgroundWorker(BackgroundWorker const&) = delete;
+    BackgroundWorker& operator=(BackgroundWorker const&) = delete;
+
+    void start(Job job) {
+        auto cancelled = std::make_shared<Cancelled>(false);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (current) *current = true;
+            current = cancelled;
+            pending = {std::move(job), cancelled};
+            has_pending = true;
+        }
+        wake.notify_one();
+    }
+
+    void cancel() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (current) *current = true;
+        has_pending = false;
+    }
+
+    // Whether a job is running or waiting to run
+    bool busy() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return running || has_pending;
+    }
+
+    // Called from a job, with the flag it was given, to have func run on
+    // the owning thread.
+    void post(Cancelled const& cancelled, std::function<void()> func) {
+        std::shared_ptr<Cancelled> flag;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!current || current.get() != &cancelled || cancelled) return;
+            flag = current;
+        }
+        std::lock_guard<std::mutex> lock(posted_mutex);
+        posted.emplace_back(std::move(flag), std::move(func));
+    }
+
+    // Runs the posted results of the latest job, returns how many ran.
+    std::size_t runPosted() {
+        decltype(posted) ready;
+        {
+            std::lock_guard<std::mutex> lock(posted_mutex);
+            ready.swap(posted);
+        }
+        std::size_t count = 0;
+        for (auto& p : ready) {
+            if (*p.first) continue;
+            p.second();
+            ++count;
+        }
+        return count;
+    }
+};
+
+#endif // WORKER_HPP